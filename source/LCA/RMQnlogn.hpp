@@ -19,12 +19,13 @@ template<class ValType>
 class RMQnlogn
 {
 protected:
-    static std::vector<size_t> log_table;
+    std::vector<size_t> log_table; // per instance, so that several RMQs can be used in parallel
     std::vector<ValType> A;
     std::vector<std::vector<ValType> > M;
 
-    static size_t log2(size_t n);
+    size_t log2(size_t n);
 public:
+    RMQnlogn();
     void reserve(size_t n);
     void clear();
     void push_back(const ValType& val);
@@ -33,10 +34,12 @@ public:
 };
 
 template<class ValType>
-/*static*/ std::vector<size_t> RMQnlogn<ValType>::log_table(2, 0);
+RMQnlogn<ValType>::RMQnlogn():
+    log_table(2, 0)
+{}
 
 template<class ValType>
-/*static*/ size_t RMQnlogn<ValType>::log2(size_t n)
+size_t RMQnlogn<ValType>::log2(size_t n)
 {
     while(log_table.size() <= n)
         log_table.insert(log_table.end(), log_table.size(), 1 + log_table.back());
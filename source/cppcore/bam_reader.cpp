@@ -0,0 +1,312 @@
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <zlib.h>
+#include <parallel.h>
+#include "bam_reader.h"
+
+namespace loon
+{
+
+namespace
+{
+
+const size_t BGZF_HEADER_SIZE = 18;
+const size_t BGZF_MAX_BLOCK_SIZE = 0x10000;
+const size_t BLOCKS_PER_THREAD = 64;
+
+inline uint16_t le_uint16(const char* p)
+{
+    const unsigned char* q = reinterpret_cast<const unsigned char*>(p);
+    return uint16_t(q[0]) | (uint16_t(q[1]) << 8);
+}
+
+inline uint32_t le_uint32(const char* p)
+{
+    const unsigned char* q = reinterpret_cast<const unsigned char*>(p);
+    return uint32_t(q[0]) | (uint32_t(q[1]) << 8) | (uint32_t(q[2]) << 16) | (uint32_t(q[3]) << 24);
+}
+
+inline int32_t le_int32(const char* p)
+{
+    return static_cast<int32_t>( le_uint32(p) );
+}
+
+}// anonymous namespace
+
+BgzfReader::BgzfReader():
+    fin(NULL), n_threads(1), buf_pos(0), at_eof(true)
+{}
+
+BgzfReader::~BgzfReader()
+{
+    close();
+}
+
+void BgzfReader::open(const std::string& fname, int n_threads/* = 1*/)
+{
+    close();
+    fin = fopen(fname.c_str(), "rb");
+    if(! fin)   throw std::runtime_error("bam_reader: cannot open file [" + fname + "]");
+    this->fname = fname;
+    this->n_threads = std::max(1, n_threads);
+    buffer.clear();
+    buf_pos = 0;
+    at_eof = false;
+}
+
+void BgzfReader::close()
+{
+    if(fin) fclose(fin);
+    fin = NULL;
+    at_eof = true;
+    compressed.clear();
+    buffer.clear();
+    buf_pos = 0;
+}
+
+bool BgzfReader::read_block()
+{
+    size_t offset = compressed.size();
+    compressed.resize(offset + BGZF_HEADER_SIZE);
+    size_t n = fread(&compressed[offset], 1, BGZF_HEADER_SIZE, fin);
+    if(n == 0)
+    {
+        compressed.resize(offset);
+        return false;
+    }
+    const char* h = &compressed[offset];
+    if(n != BGZF_HEADER_SIZE || (unsigned char)h[0] != 31 || (unsigned char)h[1] != 139
+            || h[2] != 8 || !(h[3] & 4))
+        throw std::runtime_error("bam_reader: file [" + fname + "] is not in BGZF format");
+
+    // find the BC subfield holding the block size
+    size_t xlen = le_uint16(h + 10);
+    if(xlen + 12 < BGZF_HEADER_SIZE)
+        throw std::runtime_error("bam_reader: file [" + fname + "] has a bad BGZF block");
+    compressed.resize(offset + 12 + xlen);
+    if(xlen + 12 > BGZF_HEADER_SIZE &&
+            fread(&compressed[offset + BGZF_HEADER_SIZE], 1, xlen + 12 - BGZF_HEADER_SIZE, fin) != xlen + 12 - BGZF_HEADER_SIZE)
+        throw std::runtime_error("bam_reader: file [" + fname + "] is truncated");
+    size_t block_size = 0;
+    for(size_t i = 12; i + 4 <= 12 + xlen; i += 4 + le_uint16(&compressed[offset + i + 2]))
+    {
+        const char* sf = &compressed[offset + i];
+        if(sf[0] == 66 && sf[1] == 67 && le_uint16(sf + 2) == 2 && i + 6 <= 12 + xlen)
+        {
+            block_size = le_uint16(sf + 4) + 1;
+            break;
+        }
+    }
+    if(block_size < 12 + xlen + 8)
+        throw std::runtime_error("bam_reader: file [" + fname + "] has a bad BGZF block");
+
+    size_t n_read = compressed.size() - offset;
+    compressed.resize(offset + block_size);
+    if(fread(&compressed[offset + n_read], 1, block_size - n_read, fin) != block_size - n_read)
+        throw std::runtime_error("bam_reader: file [" + fname + "] is truncated");
+    return true;
+}
+
+void BgzfReader::inflate_block(size_t i)
+{
+    const char* block = &compressed[ block_offsets[i] ];
+    size_t block_size = block_offsets[i + 1] - block_offsets[i];
+    size_t xlen = le_uint16(block + 10);
+    size_t isize = data_offsets[i + 1] - data_offsets[i];
+    if(isize == 0)  return;
+
+    z_stream zs;
+    std::memset(&zs, 0, sizeof(zs));
+    if(inflateInit2(&zs, -15) != Z_OK)
+        throw std::runtime_error("bam_reader: cannot initialize zlib");
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(block + 12 + xlen));
+    zs.avail_in = block_size - 12 - xlen - 8;
+    zs.next_out = reinterpret_cast<Bytef*>(&buffer[ data_offsets[i] ]);
+    zs.avail_out = isize;
+    int ret = inflate(&zs, Z_FINISH);
+    inflateEnd(&zs);
+    if(ret != Z_STREAM_END || zs.avail_out != 0)
+        throw std::runtime_error("bam_reader: failed to inflate a BGZF block of file [" + fname + "]");
+    if(crc32(crc32(0L, Z_NULL, 0), reinterpret_cast<const Bytef*>(&buffer[ data_offsets[i] ]), isize)
+            != le_uint32(block + block_size - 8))
+        throw std::runtime_error("bam_reader: CRC mismatch in file [" + fname + "]");
+}
+
+bool BgzfReader::fill()
+{
+    if(at_eof)  return false;
+
+    compressed.clear();
+    block_offsets.assign(1, 0);
+    size_t max_blocks = n_threads * BLOCKS_PER_THREAD;
+    while(block_offsets.size() <= max_blocks && read_block())
+        block_offsets.push_back( compressed.size() );
+    size_t n_blocks = block_offsets.size() - 1;
+    if(n_blocks == 0)
+    {
+        at_eof = true;
+        return false;
+    }
+
+    // keep the unread bytes in front of the new data
+    buffer.erase(buffer.begin(), buffer.begin() + buf_pos);
+    buf_pos = 0;
+    data_offsets.assign(1, buffer.size());
+    for(size_t i = 0; i < n_blocks; ++i)
+    {
+        size_t isize = le_uint32(&compressed[ block_offsets[i + 1] - 4 ]);
+        if(isize > BGZF_MAX_BLOCK_SIZE)
+            throw std::runtime_error("bam_reader: file [" + fname + "] has a bad BGZF block");
+        data_offsets.push_back( data_offsets.back() + isize );
+    }
+    buffer.resize( data_offsets.back() );
+
+    parallel_for(n_blocks, n_threads, [this](size_t i) { inflate_block(i); });
+    return true;
+}
+
+bool BgzfReader::read(void* data, size_t n)
+{
+    while(buffer.size() - buf_pos < n)
+    {
+        if(! fill())
+        {
+            if(buffer.size() == buf_pos)    return false;
+            throw std::runtime_error("bam_reader: file [" + fname + "] is truncated");
+        }
+    }
+    std::memcpy(data, &buffer[buf_pos], n);
+    buf_pos += n;
+    return true;
+}
+
+bool BamRecord::is_unmapped() const
+{
+    return flag & 0x4;
+}
+
+bool BamRecord::is_secondary() const
+{
+    return flag & 0x100;
+}
+
+bool BamRecord::is_reverse() const
+{
+    return flag & 0x10;
+}
+
+void BamReader::open(const std::string& fname, int n_threads/* = 1*/)
+{
+    bgzf.open(fname, n_threads);
+    ref_names.clear();
+    ref_lengths.clear();
+
+    char buf[4];
+    if(! bgzf.read(buf, 4) || std::memcmp(buf, "BAM\1", 4) != 0)
+        throw std::runtime_error("bam_reader: file [" + fname + "] is not a BAM file");
+    if(! bgzf.read(buf, 4))
+        throw std::runtime_error("bam_reader: file [" + fname + "] is truncated");
+    data.resize( le_uint32(buf) );
+    if(! data.empty() && ! bgzf.read(&data[0], data.size()))
+        throw std::runtime_error("bam_reader: file [" + fname + "] is truncated");
+
+    if(! bgzf.read(buf, 4))
+        throw std::runtime_error("bam_reader: file [" + fname + "] is truncated");
+    size_t n_refs = le_uint32(buf);
+    ref_names.resize( n_refs );
+    ref_lengths.resize( n_refs );
+    for(size_t i = 0; i < n_refs; ++i)
+    {
+        if(! bgzf.read(buf, 4))
+            throw std::runtime_error("bam_reader: file [" + fname + "] is truncated");
+        data.resize( le_uint32(buf) );
+        if(data.empty() || ! bgzf.read(&data[0], data.size()) || ! bgzf.read(buf, 4))
+            throw std::runtime_error("bam_reader: file [" + fname + "] has a bad header");
+        ref_names[i].assign(&data[0], data.size() - 1);
+        ref_lengths[i] = le_uint32(buf);
+    }
+}
+
+void BamReader::close()
+{
+    bgzf.close();
+}
+
+size_t BamReader::number_of_references() const
+{
+    return ref_names.size();
+}
+
+const std::string& BamReader::get_ref_name(size_t i) const
+{
+    return ref_names[i];
+}
+
+long long BamReader::get_ref_length(size_t i) const
+{
+    return ref_lengths[i];
+}
+
+bool BamReader::next(BamRecord& rec)
+{
+    char buf[4];
+    if(! bgzf.read(buf, 4))     return false;
+    size_t block_size = le_uint32(buf);
+    if(block_size < 32)
+        throw std::runtime_error("bam_reader: bad BAM record");
+    data.resize( block_size );
+    if(! bgzf.read(&data[0], block_size))
+        throw std::runtime_error("bam_reader: truncated BAM record");
+    const char* p = &data[0];
+
+    rec.ref_id = le_int32(p);
+    rec.r_start = le_int32(p + 4);
+    size_t l_read_name = static_cast<unsigned char>(p[8]);
+    rec.mapping_quality = static_cast<unsigned char>(p[9]);
+    size_t n_cigar_op = le_uint16(p + 12);
+    rec.flag = le_uint16(p + 14);
+    rec.q_length = le_int32(p + 16);
+    if(32 + l_read_name + 4 * n_cigar_op > block_size || l_read_name == 0)
+        throw std::runtime_error("bam_reader: bad BAM record");
+    rec.q_name = p + 32;
+    rec.q_name_length = l_read_name - 1;
+
+    // walk the CIGAR for the reference end and the soft clips
+    const char* cigar = p + 32 + l_read_name;
+    long long r_len = 0, q_len = 0, clip_front = 0, clip_back = 0;
+    bool aligned = false;
+    for(size_t i = 0; i < n_cigar_op; ++i)
+    {
+        uint32_t op = le_uint32(cigar + 4 * i);
+        long long len = op >> 4;
+        switch(op & 0xF)
+        {
+        case 0: case 7: case 8: // M, =, X
+            r_len += len;   q_len += len;
+            aligned = true;     clip_back = 0;
+            break;
+        case 1: // I
+            q_len += len;
+            aligned = true;     clip_back = 0;
+            break;
+        case 2: case 3: // D, N
+            r_len += len;
+            aligned = true;     clip_back = 0;
+            break;
+        case 4: // S
+            q_len += len;
+            if(aligned) clip_back += len;
+            else        clip_front += len;
+            break;
+        default: // H, P
+            break;
+        }
+    }
+    rec.r_end = rec.r_start + r_len;
+    rec.q_start = clip_front;
+    rec.q_end = (rec.q_length > 0 ? rec.q_length : q_len) - clip_back;
+    return true;
+}
+
+}// namespace loon
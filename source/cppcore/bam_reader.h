@@ -0,0 +1,73 @@
+#ifndef __INVDET_BAM_READER_H
+#define __INVDET_BAM_READER_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace loon
+{
+
+// Reader of a BGZF file (the compression layer of BAM).
+// The compressed blocks are read in batches and inflated by `n_threads` threads.
+class BgzfReader
+{
+private:
+    FILE* fin;
+    std::string fname;
+    int n_threads;
+    std::vector<char> compressed;
+    std::vector<size_t> block_offsets;      // offsets of the blocks in `compressed`
+    std::vector<size_t> data_offsets;       // offsets of the inflated blocks in `buffer`
+    std::vector<char> buffer;
+    size_t buf_pos;
+    bool at_eof;
+
+    bool read_block(); // append the next compressed block to `compressed`
+    void inflate_block(size_t i);
+    bool fill();
+public:
+    BgzfReader();
+    ~BgzfReader();
+    void open(const std::string& fname, int n_threads = 1);
+    void close();
+    bool read(void* data, size_t n); // false at the end of file
+};
+
+class BamRecord
+{
+public:
+    int32_t ref_id;
+    long long r_start, r_end;       // [r_start, r_end) on the reference
+    long long q_length;
+    long long q_start, q_end;       // [q_start, q_end) of the aligned part of the query
+    short mapping_quality;
+    uint16_t flag;
+    const char* q_name;
+    size_t q_name_length;
+public:
+    bool is_unmapped() const;
+    bool is_secondary() const;
+    bool is_reverse() const;
+};
+
+class BamReader
+{
+private:
+    BgzfReader bgzf;
+    std::vector<std::string> ref_names;
+    std::vector<long long> ref_lengths;
+    std::vector<char> data;
+public:
+    void open(const std::string& fname, int n_threads = 1);
+    void close();
+    size_t number_of_references() const;
+    const std::string& get_ref_name(size_t i) const;
+    long long get_ref_length(size_t i) const;
+    bool next(BamRecord& rec); // the record is valid until the next call
+};
+
+}// namespace loon
+
+#endif
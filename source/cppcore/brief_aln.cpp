@@ -0,0 +1,215 @@
+#include <fstream>
+#include <stdexcept>
+#include <cstring>
+#include "brief_aln.h"
+
+namespace loon
+{
+
+/*static*/ const char BriefAlnFile::magic[8] = {'I', 'N', 'V', 'D', 'B', 'A', 'L', '1'};
+
+namespace
+{
+
+// bytes used by the columns of `n` alignments, padded to 8 bytes
+uint64_t block_size(uint64_t n)
+{
+    uint64_t sz = n * (7 * sizeof(int64_t) + sizeof(int16_t) + 2 * sizeof(char));
+    return (sz + 7) & ~uint64_t(7);
+}
+
+template<class T>
+void write_column(std::ofstream& fout, const std::vector<T>& col)
+{
+    if(! col.empty())
+        fout.write(reinterpret_cast<const char*>(&col[0]), col.size() * sizeof(T));
+}
+
+}// anonymous namespace
+
+BriefAlnFile::BriefAlnFile():
+    data(NULL), data_size(0), ref_table(NULL), n_refs(0)
+{}
+
+BriefAlnFile::~BriefAlnFile()
+{
+    close();
+}
+
+/*static*/ bool BriefAlnFile::is_binary(const std::string& fname)
+{
+    std::ifstream fin(fname.c_str(), std::ios::binary);
+    if(! fin.is_open())     throw std::runtime_error("brief_aln: cannot open file [" + fname + "]");
+    char buf[sizeof(magic)];
+    if(! fin.read(buf, sizeof(magic)))  return false;
+    return std::memcmp(buf, magic, sizeof(magic)) == 0;
+}
+
+/*static*/ void BriefAlnFile::write(const std::string& fname, const std::vector<Region>& regions)
+{
+    std::ofstream fout(fname.c_str(), std::ios::binary);
+    if(! fout.is_open())    throw std::runtime_error("brief_aln: cannot open file [" + fname + "]");
+
+    uint64_t n = regions.size();
+    std::vector<RefEntry> table( n );
+    uint64_t offset = sizeof(magic) + sizeof(uint64_t) + n * sizeof(RefEntry);
+    for(size_t i = 0; i < n; ++i)
+    {
+        table[i].block_offset = offset;
+        table[i].n_alns = regions[i].size();
+        table[i].r_length = regions[i].get_length();
+        offset += block_size( table[i].n_alns );
+    }
+    for(size_t i = 0; i < n; ++i)
+    {
+        table[i].name_offset = offset;
+        table[i].name_length = regions[i].get_name().length();
+        offset += table[i].name_length;
+    }
+
+    fout.write(magic, sizeof(magic));
+    fout.write(reinterpret_cast<const char*>(&n), sizeof(n));
+    if(n > 0)
+        fout.write(reinterpret_cast<const char*>(&table[0]), n * sizeof(RefEntry));
+
+    std::vector<uint64_t> q_id;
+    std::vector<int64_t> q_raw_len, q_length, r_start, r_end, q_start, q_end;
+    std::vector<int16_t> mapping_quality;
+    std::vector<char> q_pos, direction;
+    for(size_t i = 0; i < n; ++i)
+    {
+        const Region& region = regions[i];
+        size_t m = region.size();
+        q_id.resize(m);     q_raw_len.resize(m);    q_length.resize(m);
+        r_start.resize(m);  r_end.resize(m);
+        q_start.resize(m);  q_end.resize(m);
+        mapping_quality.resize(m);
+        q_pos.resize(m);    direction.resize(m);
+        for(size_t j = 0; j < m; ++j)
+        {
+            OneAln aln = region[j];
+            q_id[j] = aln.q_id;
+        #ifdef FOR_NORA_EXAMINATION
+            q_raw_len[j] = aln.q_raw_len;
+        #else
+            q_raw_len[j] = 0;
+        #endif
+            q_length[j] = aln.q_length;
+            r_start[j] = aln.r_start;   r_end[j] = aln.r_end;
+            q_start[j] = aln.q_start;   q_end[j] = aln.q_end;
+            mapping_quality[j] = aln.mapping_quality;
+            q_pos[j] = aln.q_pos;
+            direction[j] = aln.direction;
+        }
+        write_column(fout, q_id);
+        write_column(fout, q_raw_len);
+        write_column(fout, q_length);
+        write_column(fout, r_start);
+        write_column(fout, r_end);
+        write_column(fout, q_start);
+        write_column(fout, q_end);
+        write_column(fout, mapping_quality);
+        write_column(fout, q_pos);
+        write_column(fout, direction);
+        static const char padding[8] = {0};
+        fout.write(padding, block_size(m) - m * (7 * sizeof(int64_t) + sizeof(int16_t) + 2 * sizeof(char)));
+    }
+    for(size_t i = 0; i < n; ++i)
+        fout.write(regions[i].get_name().data(), regions[i].get_name().length());
+
+    if(! fout)  throw std::runtime_error("brief_aln: failed to write file [" + fname + "]");
+    fout.close();
+}
+
+void BriefAlnFile::open(const std::string& fname)
+{
+    close();
+    if(! file.open(fname, MADV_SEQUENTIAL))
+        throw std::runtime_error("brief_aln: cannot open file [" + fname + "]");
+    data = file.data();
+    data_size = file.size();
+    if(data_size < sizeof(magic) + sizeof(uint64_t))
+    {
+        close();
+        throw std::runtime_error("brief_aln: file [" + fname + "] is too short");
+    }
+
+    if(std::memcmp(data, magic, sizeof(magic)) != 0)
+    {
+        close();
+        throw std::runtime_error("brief_aln: file [" + fname + "] is not a binary brief_alignment file");
+    }
+    n_refs = *reinterpret_cast<const uint64_t*>(data + sizeof(magic));
+    ref_table = reinterpret_cast<const RefEntry*>(data + sizeof(magic) + sizeof(uint64_t));
+    if(n_refs > (data_size - sizeof(magic) - sizeof(uint64_t)) / sizeof(RefEntry))
+    {
+        close();
+        throw std::runtime_error("brief_aln: file [" + fname + "] is truncated");
+    }
+    for(size_t i = 0; i < n_refs; ++i)
+    {
+        const RefEntry& e = ref_table[i];
+        if(e.block_offset % 8 != 0 || e.block_offset > data_size ||
+                block_size(e.n_alns) > data_size - e.block_offset ||
+                e.name_offset > data_size || e.name_length > data_size - e.name_offset)
+        {
+            close();
+            throw std::runtime_error("brief_aln: file [" + fname + "] is corrupted");
+        }
+    }
+}
+
+void BriefAlnFile::close()
+{
+    file.close();
+    data = NULL;
+    data_size = 0;
+    ref_table = NULL;
+    n_refs = 0;
+}
+
+size_t BriefAlnFile::size() const
+{
+    return n_refs;
+}
+
+size_t BriefAlnFile::number_of_alignments(size_t ref_id) const
+{
+    return ref_table[ ref_id ].n_alns;
+}
+
+long long BriefAlnFile::ref_length(size_t ref_id) const
+{
+    return ref_table[ ref_id ].r_length;
+}
+
+std::string BriefAlnFile::ref_name(size_t ref_id) const
+{
+    return std::string(data + ref_table[ ref_id ].name_offset, ref_table[ ref_id ].name_length);
+}
+
+void BriefAlnFile::load(size_t ref_id, Region& region) const
+{
+    const RefEntry& e = ref_table[ ref_id ];
+    size_t n = e.n_alns;
+    const char* p = data + e.block_offset;
+    const uint64_t* q_id = reinterpret_cast<const uint64_t*>(p);
+    const int64_t* q_raw_len = reinterpret_cast<const int64_t*>(q_id + n);
+    const int64_t* q_length = q_raw_len + n;
+    const int64_t* r_start = q_length + n;
+    const int64_t* r_end = r_start + n;
+    const int64_t* q_start = r_end + n;
+    const int64_t* q_end = q_start + n;
+    const int16_t* mapping_quality = reinterpret_cast<const int16_t*>(q_end + n);
+    const char* q_pos = reinterpret_cast<const char*>(mapping_quality + n);
+    const char* direction = q_pos + n;
+
+    region.add_ref_info(e.r_length, ref_name( ref_id ));
+    region.reserve( region.size() + n );
+    for(size_t i = 0; i < n; ++i)
+        region.push_back( q_id[i], q_pos[i], q_raw_len[i], q_length[i],
+                r_start[i], r_end[i], q_start[i], q_end[i],
+                mapping_quality[i], direction[i] );
+}
+
+}// namespace loon
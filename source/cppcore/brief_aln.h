@@ -0,0 +1,69 @@
+#ifndef __INVDET_BRIEF_ALN_H
+#define __INVDET_BRIEF_ALN_H
+
+/*
+Binary brief_alignment file (little-endian, every section 8-byte aligned)
+
+    header      char magic[8] = "INVDBAL1"
+                uint64 n_refs
+    ref table   n_refs x { uint64 block_offset, uint64 n_alns, int64 r_length,
+                           uint64 name_offset, uint64 name_length }
+    blocks      one block per reference, holding the columns of its alignments
+                    uint64 q_id[n]
+                    int64  q_raw_len[n]     (0 if unknown)
+                    int64  q_length[n]
+                    int64  r_start[n], r_end[n]
+                    int64  q_start[n], q_end[n]
+                    int16  mapping_quality[n]
+                    char   q_pos[n]         ('5' or '3')
+                    char   direction[n]     ('F' or 'R')
+                padded with zeros to 8 bytes
+    names       reference names, not null-terminated
+
+The offsets are counted from the beginning of the file.
+*/
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <mapped_file.h>
+#include "region.h"
+
+namespace loon
+{
+
+class BriefAlnFile
+{
+private:
+    struct RefEntry
+    {
+        uint64_t block_offset;
+        uint64_t n_alns;
+        int64_t r_length;
+        uint64_t name_offset;
+        uint64_t name_length;
+    };
+    MappedFile file;
+    const char* data;
+    size_t data_size;
+    const RefEntry* ref_table;
+    size_t n_refs;
+public:
+    static const char magic[8];
+
+    BriefAlnFile();
+    ~BriefAlnFile();
+    static bool is_binary(const std::string& fname);
+    static void write(const std::string& fname, const std::vector<Region>& regions);
+    void open(const std::string& fname);
+    void close();
+    size_t size() const;
+    size_t number_of_alignments(size_t ref_id) const;
+    long long ref_length(size_t ref_id) const;
+    std::string ref_name(size_t ref_id) const;
+    void load(size_t ref_id, Region& region) const;
+};
+
+}// namespace loon
+
+#endif
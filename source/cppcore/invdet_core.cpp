@@ -2,12 +2,132 @@
 #include <fstream>
 #include <stdexcept>
 #include <cstdlib>
+#include <sstream>
+#include <algorithm>
+#include <parallel.h>
 #include "invdet_core.h"
+#include "brief_aln.h"
+#include "bam_reader.h"
+#include "repeat_index.h"
 
 namespace loon
 {
 
+namespace
+{
+
+// next alignment of a BAM file that goes into a Region
+bool next_mapped(BamReader& fin, BamRecord& rec)
+{
+    while(fin.next(rec))
+        if(! rec.is_unmapped() && ! rec.is_secondary() && rec.ref_id >= 0)
+            return true;
+    return false;
+}
+
+// references handled by each thread before the buffered outputs are flushed
+const size_t REFS_PER_THREAD = 16;
+
+// a graph of graph_file and its solution in graph_cut
+struct GraphCut
+{
+    size_t ref_id;
+    std::vector<int> node_names;
+    std::vector<bool> solution;
+    std::vector<VertexPair> edges;
+};
+
+// output files of the report stage; graph_file and graph_cut are skipped
+// when their names are empty
+class ReportFiles
+{
+private:
+    std::ofstream graph_fout, maxcut_fout, inv_fout;
+#ifdef FOR_NORA_EXAMINATION
+    std::ofstream seg_fout, graph_bridge_fout;
+#endif
+
+    static void open_file(std::ofstream& fout, const std::string& fname)
+    {
+        fout.open( fname.c_str() );
+        if(! fout.is_open())    throw std::runtime_error("invdet_core: cannot open file [" + fname + "]");
+    }
+public:
+    void open(const std::string& graph_fname, const std::string& maxcut_fname,
+            const std::string& inversion_fname, size_t n_refs)
+    {
+        if(! graph_fname.empty())   open_file(graph_fout, graph_fname);
+        if(! maxcut_fname.empty())  open_file(maxcut_fout, maxcut_fname);
+        open_file(inv_fout, inversion_fname);
+    #ifdef FOR_NORA_EXAMINATION
+        if(! graph_fname.empty())
+        {
+            open_file(seg_fout, graph_fname + ".seg");
+            open_file(graph_bridge_fout, graph_fname + ".graph_bridge");
+            seg_fout << n_refs << std::endl;
+        }
+    #else
+        (void)n_refs;   // only written to graph_file.seg
+    #endif
+    }
+
+    bool keep_graph() const     { return graph_fout.is_open(); }
+    bool keep_maxcut() const    { return maxcut_fout.is_open(); }
+
+    void write(const InvDector::RegionReport& result)
+    {
+        if(graph_fout.is_open())    graph_fout << result.graph;
+        if(maxcut_fout.is_open())   maxcut_fout << result.maxcut;
+        inv_fout << result.inversion;
+    #ifdef FOR_NORA_EXAMINATION
+        if(seg_fout.is_open())
+        {
+            seg_fout << result.seg;
+            graph_bridge_fout << result.graph_bridge;
+        }
+    #endif
+        std::cout << result.debug;
+    }
+
+    void close()
+    {
+        graph_fout.close();
+        maxcut_fout.close();
+        inv_fout.close();
+    #ifdef FOR_NORA_EXAMINATION
+        seg_fout.close();
+        graph_bridge_fout.close();
+    #endif
+        std::cout.flush();
+    }
+};
+
+// indices [0, n) ordered by decreasing `sizes[i]`, so that the big tasks are started first
+template<class SizeFunc>
+void largest_first(size_t n, SizeFunc sizes, std::vector<size_t>& order)
+{
+    order.resize(n);
+    for(size_t k = 0; k < n; ++k)
+        order[k] = k;
+    std::stable_sort(order.begin(), order.end(),
+            [&sizes](size_t a, size_t b) { return sizes(a) > sizes(b); });
+}
+
+}// anonymous namespace
+
+InvDector::InvDector():
+    repeat_finder(NULL)
+{}
+
 void InvDector::read(const std::string& fname)
+{
+    if(BriefAlnFile::is_binary(fname))
+        read_binary(fname);
+    else
+        read_text(fname);
+}
+
+void InvDector::read_text(const std::string& fname)
 {
     std::ifstream fin(fname.c_str());
     if(! fin.is_open())     throw std::runtime_error("invdet_core: cannot open file [" + fname + "]");
@@ -19,7 +139,7 @@ void InvDector::read(const std::string& fname)
     std::string name;
     for(size_t i = 0; i < n; ++i)
     {
-        fin >> len;
+        fin >> len >> std::ws;  // the name as in the BAM header, without the blank before it
         getline(fin, name);
         regions[i].add_ref_info(len, name);
     }
@@ -38,9 +158,91 @@ void InvDector::read(const std::string& fname)
     fin.close();
 }
 
+void InvDector::read_binary(const std::string& fname)
+{
+    BriefAlnFile fin;
+    fin.open(fname);
+    regions.assign(fin.size(), Region());
+    for(size_t i = 0; i < fin.size(); ++i)
+        fin.load(i, regions[i]);
+    fin.close();
+}
+
+void InvDector::read_bam(const std::string& fname, int n_threads/* = 1*/)
+{
+    BamReader fin;
+    fin.open(fname, n_threads);
+    regions.assign(fin.number_of_references(), Region());
+    for(size_t i = 0; i < regions.size(); ++i)
+        regions[i].add_ref_info(fin.get_ref_length(i), fin.get_ref_name(i));
+
+    BamRecord rec;
+    while(fin.next(rec))
+    {
+        if(rec.is_unmapped() || rec.is_secondary() || rec.ref_id < 0)
+            continue;
+        if(size_t(rec.ref_id) >= regions.size())
+            throw std::runtime_error("invdet_core: bad reference id in file [" + fname + "]");
+        regions[ rec.ref_id ].push_back( rec.q_name, rec.q_name_length, rec.q_length, rec.r_start, rec.r_end,
+                rec.q_start, rec.q_end, rec.mapping_quality, rec.is_reverse() ? 'R' : 'F' );
+    }
+    fin.close();
+}
+
+void InvDector::write_binary(const std::string& fname) const
+{
+    BriefAlnFile::write(fname, regions);
+}
+
+void InvDector::set_repeat_finder(const RepeatFinder* finder)
+{
+    repeat_finder = finder;
+}
+
+// NULL if the inverted repeats are not used
+RepeatCache* InvDector::open_inverted_repeats(const std::string& nucmer_prefix, size_t n_refs)
+{
+    if(repeat_finder)
+        inv_repeats.open(*repeat_finder, n_refs);
+    else if(! nucmer_prefix.empty())
+        inv_repeats.open(nucmer_prefix, n_refs);
+    else
+        return NULL;
+    return &inv_repeats;
+}
+
+#ifdef FOR_NORA_EXAMINATION
+void InvDector::gen_graph(size_t r_id, Region& region,
+        int min_cvg, double min_cvg_percent, int min_overlap,
+        RepeatCache* inv_repeats, int n_threads, std::vector<VertexPair>& edges,
+        std::ostream& fout_seg, std::ostream& fout_graph_bridge)
+#else
+void InvDector::gen_graph(size_t r_id, Region& region,
+        int min_cvg, double min_cvg_percent, int min_overlap,
+        RepeatCache* inv_repeats, int n_threads, std::vector<VertexPair>& edges)
+#endif
+{
+    region.remove_low_coverage_reads(min_cvg, min_cvg_percent);
+    region.gen_vertices(min_overlap);
+
+#ifdef FOR_NORA_EXAMINATION
+    region.write_vertices(r_id, fout_seg);
+#endif
+
+    // the inverted repeats are only needed if the reads may give an edge
+    if(region.make_pairs() && inv_repeats)
+        region.filter_pairs( inv_repeats->get(r_id, n_threads) );
+#ifdef FOR_NORA_EXAMINATION
+    region.gen_edges( edges, r_id, fout_graph_bridge );
+#else
+    region.gen_edges( edges );
+#endif
+}
+
 void InvDector::gen_graphs(const std::string& fname,
         int min_cvg/* = 0*/, double min_cvg_percent/* = 0.0 */,
-        int min_overlap/* = 0*/, const std::string& nucmer_prefix/* = ""*/)
+        int min_overlap/* = 0*/, const std::string& nucmer_prefix/* = ""*/,
+        int n_threads/* = 1*/)
 {
     std::ofstream fout(fname.c_str());  // graph_file: graph file
     if(! fout.is_open())    throw std::runtime_error("invdet_core: cannot open file [" + fname + "]");
@@ -50,41 +252,57 @@ void InvDector::gen_graphs(const std::string& fname,
     if(! fout_seg.is_open())    throw std::runtime_error("invdet_core: cannot open file [" + fname + ".seg]");
     std::ofstream fout_graph_bridge( (fname + ".graph_bridge").c_str() ); // graph_file.graph_bridge: file for reporting bridges for each pair of vertices
     if(! fout_graph_bridge.is_open())   throw std::runtime_error("invdet_core: cannot open file [" + fname + ".graph_bridge]");
-#endif
-
-    InvertedRepeats inv_repeats(nucmer_prefix);
 
-#ifdef FOR_NORA_EXAMINATION
     fout_seg << regions.size() << std::endl;
+    std::vector<std::string> seg_buf, graph_bridge_buf;
 #endif
 
-    for(size_t i = 0; i < regions.size(); ++i)
-    {
-        regions[i].remove_low_coverage_reads(min_cvg, min_cvg_percent);
-        regions[i].gen_vertices(min_overlap);
+    RepeatCache* p_inv_repeats = open_inverted_repeats(nucmer_prefix, regions.size());
 
+    // The references are processed in batches. Within a batch, every reference
+    // writes into its own buffer and the buffers are flushed in reference order,
+    // so the output does not depend on the number of threads.
+    const size_t batch_size = std::max(1, n_threads) * REFS_PER_THREAD;
+    std::vector<std::string> graph_buf;
+    std::vector<size_t> order;
+    for(size_t first = 0; first < regions.size(); first += batch_size)
+    {
+        const size_t n = std::min(batch_size, regions.size() - first);
+        largest_first(n, [&](size_t k) { return regions[first + k].size(); }, order);
+        graph_buf.assign(n, std::string());
     #ifdef FOR_NORA_EXAMINATION
-        regions[i].write_vertices(i, fout_seg);
+        seg_buf.assign(n, std::string());
+        graph_bridge_buf.assign(n, std::string());
     #endif
 
-        if(! nucmer_prefix.empty())
+        parallel_for(n, n_threads, [&](size_t k)
         {
-            inv_repeats.open( i );
-            inv_repeats.read();
-            regions[i].make_pairs( &inv_repeats );
-            inv_repeats.close();
-        }
-        else
+            size_t i = first + order[k];
+            std::vector<VertexPair> edges;
+            std::ostringstream out;
+        #ifdef FOR_NORA_EXAMINATION
+            std::ostringstream out_seg, out_graph_bridge;
+            gen_graph(i, regions[i], min_cvg, min_cvg_percent, min_overlap,
+                    p_inv_repeats, 1, edges, out_seg, out_graph_bridge);
+            seg_buf[ order[k] ] = out_seg.str();
+            graph_bridge_buf[ order[k] ] = out_graph_bridge.str();
+        #else
+            gen_graph(i, regions[i], min_cvg, min_cvg_percent, min_overlap,
+                    p_inv_repeats, 1, edges);
+        #endif
+            Region::write_graph( i, edges, out );
+            graph_buf[ order[k] ] = out.str();
+        });
+
+        for(size_t k = 0; k < n; ++k)
         {
-            regions[i].make_pairs();
+            fout << graph_buf[k];
+        #ifdef FOR_NORA_EXAMINATION
+            fout_seg << seg_buf[k];
+            fout_graph_bridge << graph_bridge_buf[k];
+        #endif
         }
-    #ifdef FOR_NORA_EXAMINATION
-        regions[i].write_graph( i, fout , fout_graph_bridge);
-    #else
-        regions[i].write_graph( i, fout );
-    #endif
     }
-    inv_repeats.clear();
     fout.close();
 
 #ifdef FOR_NORA_EXAMINATION
@@ -95,7 +313,8 @@ void InvDector::gen_graphs(const std::string& fname,
 
 void InvDector::report_inversions(const std::string& graph_fname,
         const std::string& maxcut_fname,
-        const std::string& inversion_fname)
+        const std::string& inversion_fname,
+        int n_threads/* = 1*/)
 {
     std::ifstream graph_fin( graph_fname.c_str() );
     std::ifstream maxcut_fin( maxcut_fname.c_str() );
@@ -104,21 +323,235 @@ void InvDector::report_inversions(const std::string& graph_fname,
     if(! maxcut_fin.is_open() ) throw std::runtime_error("invdet_core: cannot open file [" + maxcut_fname + "]");
     if(! inv_fout.is_open() )   throw std::runtime_error("invdet_core: cannot open file [" + inversion_fname + "]");
 
+    // read a batch of graphs, deduce their inversions in parallel and flush
+    // the buffered outputs in the order of the graph file
+    const size_t batch_size = std::max(1, n_threads) * REFS_PER_THREAD;
+    std::vector<GraphCut> cuts( batch_size );
+    std::vector<std::string> inv_buf, debug_buf;
+    std::vector<size_t> order;
     size_t n_vertices, n_edges;
     size_t ref_id;
-    while(graph_fin >> n_edges >> ref_id)
+    size_t n;
+    do
     {
-        size_t rid;
-        maxcut_fin >> n_vertices >> rid;
-        if(ref_id != rid)
-            throw std::runtime_error("invdet_core: The graph file [" + graph_fname + "] and maxcut file [" + maxcut_fname + "] are not consistent");
-        regions[ref_id].report_inversions( ref_id, n_vertices, n_edges,
-                graph_fin, maxcut_fin, inv_fout);
-    }
+        for(n = 0; n < batch_size && graph_fin >> n_edges >> ref_id; ++n)
+        {
+            size_t rid;
+            maxcut_fin >> n_vertices >> rid;
+            if(ref_id != rid)
+                throw std::runtime_error("invdet_core: The graph file [" + graph_fname + "] and maxcut file [" + maxcut_fname + "] are not consistent");
+            if(ref_id >= regions.size())
+                throw std::runtime_error("invdet_core: bad reference id in file [" + graph_fname + "]");
+            cuts[n].ref_id = ref_id;
+            Region::read_graph_cut( n_vertices, n_edges, graph_fin, maxcut_fin,
+                    cuts[n].node_names, cuts[n].solution, cuts[n].edges );
+        }
+        largest_first(n, [&](size_t k) { return cuts[k].edges.size(); }, order);
+        inv_buf.assign(n, std::string());
+        debug_buf.assign(n, std::string());
+
+        parallel_for(n, n_threads, [&](size_t k)
+        {
+            const GraphCut& cut = cuts[ order[k] ];
+            std::ostringstream inv_out, debug_out;
+            regions[ cut.ref_id ].report_inversions( cut.ref_id, cut.node_names,
+                    cut.solution, cut.edges, inv_out, debug_out );
+            inv_buf[ order[k] ] = inv_out.str();
+            debug_buf[ order[k] ] = debug_out.str();
+        });
+
+        for(size_t k = 0; k < n; ++k)
+        {
+            inv_fout << inv_buf[k];
+            std::cout << debug_buf[k];
+        }
+        std::cout.flush();
+    }while(n == batch_size);
 
     graph_fin.close();
     maxcut_fin.close();
     inv_fout.close();
 }
 
+void InvDector::set_branch_and_bound(double seconds, int max_nodes/* = 80*/)
+{
+    maxcut_settings.set_branch_and_bound(seconds, max_nodes);
+}
+
+void InvDector::set_refinement(int max_passes, double seconds/* = 0*/)
+{
+    maxcut_settings.set_refinement(max_passes, seconds);
+}
+
+void InvDector::set_sdp(int max_nodes, int min_iter/* = 100*/, int max_iter/* = 10000*/,
+        double min_ratio/* = 0.878*/, double max_ratio/* = 0.995*/)
+{
+    maxcut_settings.set_sdp(max_nodes, min_iter, max_iter, min_ratio, max_ratio);
+}
+
+void InvDector::set_maxcut_cache(const std::string& fname, bool all_cuts/* = false*/)
+{
+    if(fname.empty())
+        maxcut_cache.close();
+    else
+        maxcut_cache.open(fname, all_cuts);
+}
+
+void InvDector::solve_graph(size_t r_id, Region& region,
+        const std::vector<VertexPair>& edges, int small_threshold, int maxcut_threads,
+        std::ostream* maxcut_out, std::ostream& inv_out, std::ostream& debug_out)
+{
+    if(edges.empty())   return;
+    MaxCut& graph = MaxCutBatch::thread_graph(maxcut_settings, maxcut_threads);
+    graph.set_small_threshold(small_threshold);
+    for(std::vector<VertexPair>::const_iterator eit = edges.begin(); eit != edges.end(); ++eit)
+        graph.add_edge(eit->u, eit->v, eit->w);
+    std::vector<bool> solution;
+    double value;
+    bool optimal;
+    MaxCutBatch::solve_cached(graph, maxcut_cache, solution, value, optimal);
+
+    std::vector<int> node_names( graph.number_of_nodes() );
+    for(size_t i = 0; i < node_names.size(); ++i)
+        node_names[i] = graph.get_node_rawid(i);
+    if(maxcut_out)
+    {
+        *maxcut_out << node_names.size() << ' ' << r_id << '\n';
+        for(size_t i = 0; i < node_names.size(); ++i)
+            *maxcut_out << node_names[i] << ' ' << (solution[i] ? 1 : 0) << '\n';
+    }
+    region.report_inversions(r_id, node_names, solution, edges, inv_out, debug_out);
+}
+
+void InvDector::report_region(size_t r_id, Region& region,
+        int min_cvg, double min_cvg_percent, int min_overlap,
+        RepeatCache* inv_repeats, int small_threshold, int n_threads,
+        bool keep_graph, bool keep_maxcut, RegionReport& result)
+{
+    std::vector<VertexPair> edges;
+    std::ostringstream maxcut_out, inv_out, debug_out;
+#ifdef FOR_NORA_EXAMINATION
+    std::ostringstream seg_out, graph_bridge_out;
+    gen_graph(r_id, region, min_cvg, min_cvg_percent, min_overlap,
+            inv_repeats, n_threads, edges, seg_out, graph_bridge_out);
+    result.seg = seg_out.str();
+    result.graph_bridge = graph_bridge_out.str();
+#else
+    gen_graph(r_id, region, min_cvg, min_cvg_percent, min_overlap,
+            inv_repeats, n_threads, edges);
+#endif
+    if(keep_graph)
+    {
+        std::ostringstream graph_out;
+        Region::write_graph( r_id, edges, graph_out );
+        result.graph = graph_out.str();
+    }
+    solve_graph( r_id, region, edges, small_threshold, n_threads,
+            keep_maxcut ? &maxcut_out : NULL, inv_out, debug_out );
+    result.maxcut = maxcut_out.str();
+    result.inversion = inv_out.str();
+    result.debug = debug_out.str();
+}
+
+void InvDector::report(const std::string& graph_fname,
+        const std::string& maxcut_fname,
+        const std::string& inversion_fname,
+        int min_cvg/* = 0*/, double min_cvg_percent/* = 0.0*/,
+        int min_overlap/* = 0*/, const std::string& nucmer_prefix/* = ""*/,
+        int small_threshold/* = 15*/, int n_threads/* = 1*/)
+{
+    ReportFiles fout;
+    fout.open(graph_fname, maxcut_fname, inversion_fname, regions.size());
+    RepeatCache* p_inv_repeats = open_inverted_repeats(nucmer_prefix, regions.size());
+
+    const size_t batch_size = std::max(1, n_threads) * REFS_PER_THREAD;
+    std::vector<RegionReport> results;
+    std::vector<size_t> order;
+    for(size_t first = 0; first < regions.size(); first += batch_size)
+    {
+        const size_t n = std::min(batch_size, regions.size() - first);
+        largest_first(n, [&](size_t k) { return regions[first + k].size(); }, order);
+        results.assign(n, RegionReport());
+        parallel_for(n, n_threads, [&](size_t k)
+        {
+            size_t i = first + order[k];
+            // the references already share the threads
+            report_region( i, regions[i], min_cvg, min_cvg_percent, min_overlap,
+                    p_inv_repeats, small_threshold, 1,
+                    fout.keep_graph(), fout.keep_maxcut(), results[ order[k] ] );
+        });
+        for(size_t k = 0; k < n; ++k)
+            fout.write( results[k] );
+    }
+    fout.close();
+    maxcut_cache.flush();
+}
+
+void InvDector::stream_report(const std::string& aln_fname,
+        const std::string& graph_fname,
+        const std::string& maxcut_fname,
+        const std::string& inversion_fname,
+        int min_cvg/* = 0*/, double min_cvg_percent/* = 0.0*/,
+        int min_overlap/* = 0*/, const std::string& nucmer_prefix/* = ""*/,
+        int small_threshold/* = 15*/, int n_threads/* = 1*/)
+{
+    BriefAlnFile brief_fin;
+    BamReader bam_fin;
+    bool is_binary = BriefAlnFile::is_binary(aln_fname);
+    size_t n_refs;
+    if(is_binary)
+    {
+        brief_fin.open(aln_fname);
+        n_refs = brief_fin.size();
+    }
+    else
+    {
+        bam_fin.open(aln_fname, n_threads);
+        n_refs = bam_fin.number_of_references();
+    }
+    ReportFiles fout;
+    fout.open(graph_fname, maxcut_fname, inversion_fname, n_refs);
+
+    BamRecord rec;
+    RegionReport result;
+    RepeatCache* p_inv_repeats = open_inverted_repeats(nucmer_prefix, n_refs);
+    bool has_rec = (! is_binary && next_mapped(bam_fin, rec));
+    for(size_t i = 0; i < n_refs; ++i)
+    {
+        // only the alignments of the i-th reference are in memory
+        Region region;
+        if(is_binary)
+        {
+            brief_fin.load(i, region);
+        }
+        else
+        {
+            region.add_ref_info(bam_fin.get_ref_length(i), bam_fin.get_ref_name(i));
+            while(has_rec && size_t(rec.ref_id) == i)
+            {
+                region.push_back( rec.q_name, rec.q_name_length, rec.q_length, rec.r_start, rec.r_end,
+                        rec.q_start, rec.q_end, rec.mapping_quality, rec.is_reverse() ? 'R' : 'F' );
+                has_rec = next_mapped(bam_fin, rec);
+            }
+            if(has_rec && size_t(rec.ref_id) < i)
+                throw std::runtime_error("invdet_core: file [" + aln_fname + "] is not sorted by reference");
+        }
+
+        // one reference at a time: its repeat search and max-cut may use all the threads
+        report_region( i, region, min_cvg, min_cvg_percent, min_overlap,
+                p_inv_repeats, small_threshold, n_threads,
+                fout.keep_graph(), fout.keep_maxcut(), result );
+        fout.write( result );
+        if(p_inv_repeats)
+            p_inv_repeats->release(i);
+    }
+    if(has_rec)
+        throw std::runtime_error("invdet_core: bad reference id in file [" + aln_fname + "]");
+
+    brief_fin.close();
+    bam_fin.close();
+    fout.close();
+    maxcut_cache.flush();
+}
+
 }// namespace loon
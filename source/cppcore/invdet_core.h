@@ -4,22 +4,110 @@
 #include <vector>
 #include <string>
 #include "region.h"
+#include "maxcut.h"
+#include "maxcut_batch.h"
+#include "maxcut_cache.h"
+#include "repeat_index.h"
 
 namespace loon
 {
 
 class InvDector
 {
+public:
+    // the outputs of the report stage for one reference
+    struct RegionReport
+    {
+        std::string graph, maxcut, inversion, debug;
+#ifdef FOR_NORA_EXAMINATION
+        std::string seg, graph_bridge;
+#endif
+    };
 private:
     std::vector<Region> regions;
+    const RepeatFinder* repeat_finder;
+    RepeatCache inv_repeats;
+    MaxCutCache maxcut_cache;
+    MaxCut maxcut_settings; // holds the solver settings of all the graphs
+
+    InvDector(const InvDector&);
+    InvDector& operator=(const InvDector&);
+
+    void read_text(const std::string& fname);
+    void read_binary(const std::string& fname);
+#ifdef FOR_NORA_EXAMINATION
+    void gen_graph(size_t r_id, Region& region,
+            int min_cvg, double min_cvg_percent, int min_overlap,
+            RepeatCache* inv_repeats, int n_threads, std::vector<VertexPair>& edges,
+            std::ostream& fout_seg, std::ostream& fout_graph_bridge);
+#else
+    void gen_graph(size_t r_id, Region& region,
+            int min_cvg, double min_cvg_percent, int min_overlap,
+            RepeatCache* inv_repeats, int n_threads, std::vector<VertexPair>& edges);
+#endif
+    void solve_graph(size_t r_id, Region& region,
+            const std::vector<VertexPair>& edges, int small_threshold, int maxcut_threads,
+            std::ostream* maxcut_out, std::ostream& inv_out, std::ostream& debug_out);
+    RepeatCache* open_inverted_repeats(const std::string& nucmer_prefix, size_t n_refs);
+    void report_region(size_t r_id, Region& region,
+            int min_cvg, double min_cvg_percent, int min_overlap,
+            RepeatCache* inv_repeats, int small_threshold, int n_threads,
+            bool keep_graph, bool keep_maxcut, RegionReport& result);
 public:
-    void read(const std::string& fname);
+    InvDector();
+    void read(const std::string& fname); // text or binary brief_alignment
+    void read_bam(const std::string& fname, int n_threads = 1);
+    void write_binary(const std::string& fname) const;
     void gen_graphs(const std::string& fname, 
             int min_cvg = 0, double min_cvg_percent = 0.0,
-            int min_overlap=0, const std::string& nucmer_prefix="");
+            int min_overlap=0, const std::string& nucmer_prefix="",
+            int n_threads = 1);
     void report_inversions(const std::string& graph_fname, 
             const std::string& maxcut_fname, 
-            const std::string& inversion_fname);
+            const std::string& inversion_fname,
+            int n_threads = 1);
+
+    // Find the inverted repeats with `finder`, which holds the references in
+    // order, instead of reading them from `nucmer_prefix`; NULL undoes it. In
+    // both cases they are only looked up for the references whose reads may
+    // give an edge, and cached for the later calls.
+    void set_repeat_finder(const RepeatFinder* finder);
+    // Let MaxCut improve the spanning-tree cut of each graph that is too big
+    // for the exact algorithm by local search (see MaxCut::refine()).
+    void set_refinement(int max_passes, double seconds = 0);
+    // Let MaxCut run branch and bound for `seconds` on each graph of at most
+    // `max_nodes` vertices that is too big for the exact algorithm.
+    void set_branch_and_bound(double seconds, int max_nodes = 80);
+    // Then run MaxCut::low_rank_sdp() on the graphs of at most `max_nodes`
+    // vertices whose cut branch and bound did not prove optimal (see
+    // MaxCut::set_sdp()).
+    void set_sdp(int max_nodes, int min_iter = 100, int max_iter = 10000,
+            double min_ratio = 0.878, double max_ratio = 0.995);
+    // Look up the cut of each graph in the cache file `fname` before solving
+    // it, and add the new cuts to the file at the end of report() and
+    // stream_report(); "" closes the cache. The key covers the graph and the
+    // MaxCut settings. Only the cuts proven optimal are cached, unless
+    // all_cuts, which also keeps the time-bound cuts of the heuristics.
+    void set_maxcut_cache(const std::string& fname, bool all_cuts = false);
+    // Run the whole report stage (graphs, max-cut and inversions) on the loaded
+    // alignments, passing the graphs to MaxCut in memory. graph_file and
+    // graph_cut are only written for debugging: an empty name skips the file.
+    void report(const std::string& graph_fname,
+            const std::string& maxcut_fname,
+            const std::string& inversion_fname,
+            int min_cvg = 0, double min_cvg_percent = 0.0,
+            int min_overlap = 0, const std::string& nucmer_prefix = "",
+            int small_threshold = 15, int n_threads = 1);
+    // Same as report(), but one reference at a time, without keeping the
+    // alignments of the other references in memory. `aln_fname` is a binary
+    // brief_alignment file or a BAM file sorted by coordinate.
+    void stream_report(const std::string& aln_fname,
+            const std::string& graph_fname,
+            const std::string& maxcut_fname,
+            const std::string& inversion_fname,
+            int min_cvg = 0, double min_cvg_percent = 0.0,
+            int min_overlap = 0, const std::string& nucmer_prefix = "",
+            int small_threshold = 15, int n_threads = 1);
 };
 
 }// namespace loon
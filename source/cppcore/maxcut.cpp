@@ -1,25 +1,570 @@
+#include <chrono>
+#include <cmath>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <parallel.h>
 #include "maxcut.h"
 
 namespace loon
 {
 
-MaxCut::MaxCut(int threshold/* = 15 */):
-    small_threshold(threshold)
-{}
+namespace
+{
+
+// exact_algorithm() splits its search over threads above this many bits
+const int MIN_PARALLEL_BITS = 20;
+// the search is split into 2^PARALLEL_SPLIT_BITS tasks
+const int PARALLEL_SPLIT_BITS = 6;
+// low_rank_sdp() stops its sweeps when they improve the objective by less than
+// SDP_TOLERANCE of its value, or after SDP_MAX_SWEEPS
+const int SDP_MAX_SWEEPS = 1000;
+const double SDP_TOLERANCE = 1e-6;
+// hyperplanes drawn between two checks of the stopping rule of the rounding;
+// at most 64, as the sides of a node under a batch are packed in one word
+const int ROUNDS_PER_BATCH = 64;
+// the nodes of a batch are rounded in chunks of this many, one chunk per task
+const int ROUND_CHUNK = 1024;
+// refine() only runs its FM passes when the gains fit in this many buckets
+const int64_t MAX_GAIN_BUCKETS = int64_t(1) << 22;
+
+typedef MergedAdjacency::Neighbor Neighbor;
+
+// the best cut of one task; ties go to the smallest mask, as in a scan of the masks in increasing order
+struct BestCut
+{
+    int64_t value;
+    uint64_t mask;
+    bool improved_by(int64_t v, uint64_t m) const
+    {
+        return v > value || (v == value && m < mask);
+    }
+};
+
+// the weight of the edges between the two sides; Adjacency is a MergedAdjacency
+// or the lists of neighbors of BranchAndBound
+template<class Adjacency>
+int64_t cut_value(const Adjacency& adj, const std::vector<char>& side)
+{
+    int64_t cut = 0;
+    for(size_t v = 0; v < adj.size(); ++v)
+        for(size_t k = 0; k < adj[v].size(); ++k)
+            if(size_t(adj[v][k].v) < v && side[v] != side[ adj[v][k].v ])
+                cut += adj[v][k].w;
+    return cut;
+}
+
+// move single nodes to the other side while it increases the cut
+template<class Adjacency>
+void improve_by_flips(const Adjacency& adj, std::vector<char>& side)
+{
+    for(bool improved = true; improved; )
+    {
+        improved = false;
+        for(size_t v = 0; v < adj.size(); ++v)
+        {
+            int64_t delta = 0;
+            for(size_t k = 0; k < adj[v].size(); ++k)
+                delta += (side[v] == side[ adj[v][k].v ] ? adj[v][k].w : -adj[v][k].w);
+            if(delta > 0)
+            {
+                side[v] ^= 1;
+                improved = true;
+            }
+        }
+    }
+}
+
+// The free nodes bucketed by their gain, the change of the cut if they move
+// to the other side, as in Fiduccia-Mattheyses. All the gains are in
+// [-max_gain, max_gain]. The buckets live in `buf`, and the ones used are
+// emptied again on destruction, so that the next pass only grows them.
+class GainBuckets
+{
+private:
+    int64_t max_gain;
+    std::vector<int>& head;     // first node of each bucket, -1 if it is empty
+    std::vector<int>& next;
+    std::vector<int>& prev;
+    std::vector<int64_t>& bucket_of;
+    int64_t top;    // no bucket above it has a node
+    int64_t low, high;  // the buckets used
+public:
+    GainBuckets(size_t n, int64_t max_gain, FmBuffers& buf):
+        max_gain(max_gain), head(buf.head), next(buf.next), prev(buf.prev), bucket_of(buf.bucket_of),
+        top(-1), low(2 * max_gain + 1), high(-1)
+    {
+        if(head.size() < size_t(2 * max_gain + 1))
+            head.resize(2 * max_gain + 1, -1);
+        next.resize(n);
+        prev.resize(n);
+        bucket_of.assign(n, -1);
+    }
+    ~GainBuckets()
+    {
+        if(low <= high)
+            std::fill(head.begin() + low, head.begin() + high + 1, -1);
+    }
+    void insert(int v, int64_t gain)
+    {
+        int64_t b = gain + max_gain;
+        bucket_of[v] = b;
+        prev[v] = -1;
+        next[v] = head[b];
+        if(head[b] >= 0)    prev[ head[b] ] = v;
+        head[b] = v;
+        top = std::max(top, b);
+        low = std::min(low, b);
+        high = std::max(high, b);
+    }
+    void remove(int v)
+    {
+        int64_t b = bucket_of[v];
+        if(prev[v] >= 0)    next[ prev[v] ] = next[v];
+        else                head[b] = next[v];
+        if(next[v] >= 0)    prev[ next[v] ] = prev[v];
+        bucket_of[v] = -1;
+    }
+    bool contains(int v) const
+    {
+        return bucket_of[v] >= 0;
+    }
+    // remove and return a node of the highest gain, -1 if there is none
+    int pop_max()
+    {
+        while(top >= 0 && head[top] < 0)
+            --top;
+        if(top < 0) return -1;
+        int v = head[top];
+        remove(v);
+        return v;
+    }
+};
+
+// One pass of Fiduccia-Mattheyses: every node moves once, the best one first,
+// and the moves after the best cut seen are undone. Returns the gain of the
+// cut, >= 0.
+int64_t fm_pass(const MergedAdjacency& adj, int64_t max_gain, std::vector<char>& side, FmBuffers& buf)
+{
+    const int n = adj.size();
+    std::vector<int64_t>& gain = buf.gain;
+    gain.assign(n, 0);
+    GainBuckets buckets(n, max_gain, buf);
+    for(int v = 0; v < n; ++v)
+    {
+        for(const Neighbor* it = adj[v].begin(); it != adj[v].end(); ++it)
+            gain[v] += (side[v] == side[it->v] ? it->w : -it->w);
+        buckets.insert(v, gain[v]);
+    }
+
+    std::vector<int>& moves = buf.moves;
+    moves.clear();
+    int64_t total = 0, best = 0;
+    size_t best_moves = 0;
+    for(int v = buckets.pop_max(); v >= 0; v = buckets.pop_max())
+    {
+        total += gain[v];
+        side[v] ^= 1;
+        gain[v] = -gain[v];
+        moves.push_back(v);
+        for(const Neighbor* it = adj[v].begin(); it != adj[v].end(); ++it)
+        {
+            int u = it->v;
+            gain[u] += (side[u] == side[v] ? 2 * it->w : -2 * it->w);
+            if(buckets.contains(u))
+            {
+                buckets.remove(u);
+                buckets.insert(u, gain[u]);
+            }
+        }
+        if(total > best)
+        {
+            best = total;
+            best_moves = moves.size();
+        }
+    }
+    for(size_t k = best_moves; k < moves.size(); ++k)
+        side[ moves[k] ] ^= 1;
+    return best;
+}
+
+// Depth-first branch and bound over the nodes in a fixed order. The bound of
+// a partial assignment is its cut, plus the best side of every free node with
+// respect to the assigned ones, plus the positive weights between free nodes.
+class BranchAndBound
+{
+private:
+    int n;
+    std::vector< std::vector<Neighbor> > adj;   // by position in the order
+    std::vector<int> order;
+    std::vector<int64_t> gain[2];   // gain[s][v]: cut edges to the assigned nodes if v goes to side s
+    int64_t free_sum;   // sum of max(gain[0][v], gain[1][v]) over the free nodes
+    int64_t free_edges; // positive weights between free nodes
+    std::vector<char> side, best_side;
+    int64_t best;
+    int64_t open_bound; // bound of the subproblems left by the timeout
+    bool timed_out;
+    uint64_t steps;
+    std::chrono::steady_clock::time_point deadline;
+
+    void assign(int v, int s, int sign);
+    void search(int depth, int64_t cut);
+public:
+    BranchAndBound(const MergedAdjacency& graph);
+    // returns true if `sol` is optimal on return
+    bool run(std::vector<bool>& sol, double seconds, int64_t& value, int64_t& upper);
+};
+
+BranchAndBound::BranchAndBound(const MergedAdjacency& graph):
+    n(graph.size()), free_sum(0), free_edges(0), best(0), open_bound(0), timed_out(false), steps(0)
+{
+    // max-connectivity order from the heaviest node: the bound of a node tightens
+    // as soon as its neighbors are assigned
+    std::vector<int64_t> degree(n, 0), link(n, 0);
+    std::vector<char> placed(n, 0);
+    for(int v = 0; v < n; ++v)
+        for(size_t k = 0; k < graph[v].size(); ++k)
+            degree[v] += std::abs(graph[v][k].w);
+    for(int i = 0; i < n; ++i)
+    {
+        int next = -1;
+        for(int v = 0; v < n; ++v)
+            if(! placed[v] && (next < 0 || link[v] > link[next] ||
+                    (link[v] == link[next] && degree[v] > degree[next])))
+                next = v;
+        placed[next] = 1;
+        order.push_back(next);
+        for(size_t k = 0; k < graph[next].size(); ++k)
+            link[ graph[next][k].v ] += std::abs(graph[next][k].w);
+    }
+
+    std::vector<int> position(n);
+    for(int i = 0; i < n; ++i)
+        position[ order[i] ] = i;
+    adj.resize(n);
+    for(int i = 0; i < n; ++i)
+    {
+        MergedAdjacency::Range nbs = graph[ order[i] ];
+        for(size_t k = 0; k < nbs.size(); ++k)
+        {
+            Neighbor nb = { position[ nbs[k].v ], nbs[k].w };
+            adj[i].push_back(nb);
+            if(nb.v > i && nb.w > 0)
+                free_edges += nb.w;
+        }
+    }
+    gain[0].assign(n, 0);
+    gain[1].assign(n, 0);
+    side.assign(n, 0);
+}
+
+// sign = 1: put the free node v on side s; sign = -1: undo it
+void BranchAndBound::assign(int v, int s, int sign)
+{
+    if(sign > 0)
+        free_sum -= std::max(gain[0][v], gain[1][v]);
+    side[v] = s;
+    for(std::vector<Neighbor>::const_iterator it = adj[v].begin(); it != adj[v].end(); ++it)
+    {
+        if(it->v < v)   continue;   // assigned before v
+        int64_t& g = gain[1 - s][it->v];
+        free_sum -= std::max(gain[0][it->v], gain[1][it->v]);
+        g += sign * it->w;
+        free_sum += std::max(gain[0][it->v], gain[1][it->v]);
+        if(it->w > 0)
+            free_edges -= sign * it->w;
+    }
+    if(sign < 0)
+        free_sum += std::max(gain[0][v], gain[1][v]);
+}
+
+void BranchAndBound::search(int depth, int64_t cut)
+{
+    if(depth == n)
+    {
+        if(cut > best)
+        {
+            best = cut;
+            best_side = side;
+        }
+        return;
+    }
+    const int64_t bound = cut + free_sum + free_edges;
+    if(bound <= best)   return;
+    if((++steps & 0x3FF) == 0 && std::chrono::steady_clock::now() > deadline)
+        timed_out = true;
+    if(timed_out)
+    {
+        open_bound = std::max(open_bound, bound);
+        return;
+    }
+
+    // the first node stays on side 0: the mirror of a cut is the same cut
+    const int first = (gain[1][depth] > gain[0][depth] ? 1 : 0);
+    const int n_sides = (depth == 0 ? 1 : 2);
+    for(int k = 0; k < n_sides; ++k)
+    {
+        int s = (depth == 0 ? 0 : (k == 0 ? first : 1 - first));
+        int64_t g = gain[s][depth];
+        assign(depth, s, 1);
+        search(depth + 1, cut + g);
+        assign(depth, s, -1);
+        if(timed_out)
+        {
+            if(k + 1 < n_sides)     // the other side was not searched
+                open_bound = std::max(open_bound, bound);
+            break;
+        }
+    }
+}
+
+bool BranchAndBound::run(std::vector<bool>& sol, double seconds, int64_t& value, int64_t& upper)
+{
+    // improve the starting cut by moving single nodes
+    best_side.assign(n, 0);
+    for(int i = 0; i < n; ++i)
+        best_side[i] = sol[ order[i] ];
+    improve_by_flips(adj, best_side);
+    best = cut_value(adj, best_side);
 
-MaxCut::~MaxCut()
+    deadline = std::chrono::steady_clock::now() +
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>( std::chrono::duration<double>(seconds) );
+    if(n > 0)
+        search(0, 0);
+
+    for(int i = 0; i < n; ++i)
+        sol[ order[i] ] = best_side[i];
+    value = best;
+    upper = (timed_out ? std::max(best, open_bound) : best);
+    return ! timed_out;
+}
+
+// Burer-Monteiro factorization of the max-cut SDP: node v gets a unit vector
+// of `rank` coordinates, and the weighted sum of v_u . v_v over the edges is
+// minimized by block coordinate descent, each step setting v_u to the opposite
+// of the weighted sum of its neighbors. With rank > sqrt(2n) its local optima
+// are the optimum of the SDP for almost all graphs. Random hyperplanes through
+// the origin then split the vectors into a cut, as Goemans and Williamson do.
+class LowRankSdp
+{
+private:
+    const MergedAdjacency& adj;
+    int n, rank;
+    std::vector<double> vectors;    // the vector of node v is [v * rank, (v + 1) * rank)
+public:
+    LowRankSdp(const MergedAdjacency& graph);
+    // returns the value of the SDP
+    double solve(uint64_t seed);
+    // the cuts of the hyperplanes drawn from seeds [first, first + count), with
+    // count <= ROUNDS_PER_BATCH; bit t of sides[v] is the side of v under hyperplane t
+    void round(uint64_t first, int count, int n_threads,
+            std::vector<uint64_t>& sides, std::vector<int64_t>& cuts) const;
+};
+
+// 64-bit FNV-1a hash of the bytes of the values added, in order
+struct Fnv1a
+{
+    uint64_t value;
+    Fnv1a(): value(0xCBF29CE484222325ULL) {}
+    template<class T>
+    void add(const T& x)
+    {
+        unsigned char bytes[sizeof(T)];
+        std::memcpy(bytes, &x, sizeof(T));
+        for(size_t i = 0; i < sizeof(T); ++i)
+            value = (value ^ bytes[i]) * 0x100000001B3ULL;
+    }
+};
+
+// a well mixed 64-bit value of x, to derive independent seeds
+inline uint64_t mix_seed(uint64_t x)
+{
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+// hash of the values added, in order, by mixing each of them into the state
+// with the finalizer of SplitMix64; unrelated to Fnv1a
+struct MixHash
+{
+    uint64_t value;
+    MixHash(): value(0) {}
+    template<class T>
+    void add(const T& x)
+    {
+        uint64_t word = 0;
+        std::memcpy(&word, &x, sizeof(T) < sizeof(word) ? sizeof(T) : sizeof(word));
+        value = mix_seed(value ^ mix_seed(word));
+    }
+};
+
+// the key and the check of the max-cut cache, from the same values
+struct GraphHash
+{
+    Fnv1a first;
+    MixHash second;
+    template<class T>
+    void add(const T& x)
+    {
+        first.add(x);
+        second.add(x);
+    }
+};
+
+LowRankSdp::LowRankSdp(const MergedAdjacency& graph):
+    adj(graph), n(graph.size())
+{
+    rank = std::min(n, int(std::ceil(std::sqrt(2.0 * n))) + 1);
+    if(rank < 1)    rank = 1;
+}
+
+double LowRankSdp::solve(uint64_t seed)
 {
-    clear();
+    std::mt19937_64 rng( mix_seed(seed) );
+    std::normal_distribution<double> gauss;
+    vectors.resize(size_t(n) * rank);
+    for(int v = 0; v < n; ++v)
+    {
+        double* x = &vectors[size_t(v) * rank];
+        double norm = 0;
+        while(norm == 0)
+        {
+            for(int k = 0; k < rank; ++k)
+            {
+                x[k] = gauss(rng);
+                norm += x[k] * x[k];
+            }
+        }
+        norm = std::sqrt(norm);
+        for(int k = 0; k < rank; ++k)
+            x[k] /= norm;
+    }
+
+    double total = 0, objective = 0;   // objective: sum of w * v_u . v_v over the edges
+    for(int v = 0; v < n; ++v)
+    {
+        const double* x = &vectors[size_t(v) * rank];
+        for(const Neighbor* it = adj[v].begin(); it != adj[v].end(); ++it)
+        {
+            if(it->v >= v)  continue;
+            const double* y = &vectors[size_t(it->v) * rank];
+            double dot = 0;
+            for(int k = 0; k < rank; ++k)
+                dot += x[k] * y[k];
+            total += it->w;
+            objective += it->w * dot;
+        }
+    }
+
+    std::vector<double> g(rank);
+    for(int sweep = 0; sweep < SDP_MAX_SWEEPS; ++sweep)
+    {
+        double decrease = 0;
+        for(int v = 0; v < n; ++v)
+        {
+            double* x = &vectors[size_t(v) * rank];
+            std::fill(g.begin(), g.end(), 0.0);
+            for(const Neighbor* it = adj[v].begin(); it != adj[v].end(); ++it)
+            {
+                const double* y = &vectors[size_t(it->v) * rank];
+                for(int k = 0; k < rank; ++k)
+                    g[k] += it->w * y[k];
+            }
+            double norm = 0, dot = 0;
+            for(int k = 0; k < rank; ++k)
+            {
+                norm += g[k] * g[k];
+                dot += g[k] * x[k];
+            }
+            if(norm == 0)   continue;
+            norm = std::sqrt(norm);
+            for(int k = 0; k < rank; ++k)
+                x[k] = -g[k] / norm;
+            decrease += dot + norm;
+        }
+        objective -= decrease;
+        if(decrease <= SDP_TOLERANCE * (1.0 + std::fabs(objective)))
+            break;
+    }
+    return (total - objective) / 2;
 }
 
+void LowRankSdp::round(uint64_t first, int count, int n_threads,
+        std::vector<uint64_t>& sides, std::vector<int64_t>& cuts) const
+{
+    // the normals side by side: coordinate k of hyperplane t is normals[k * ROUNDS_PER_BATCH + t]
+    std::vector<double> normals(size_t(rank) * ROUNDS_PER_BATCH, 0.0);
+    for(int t = 0; t < count; ++t)
+    {
+        std::mt19937_64 rng( mix_seed(first + t) );
+        std::normal_distribution<double> gauss;
+        for(int k = 0; k < rank; ++k)
+            normals[size_t(k) * ROUNDS_PER_BATCH + t] = gauss(rng);
+    }
+
+    // the signs of vectors * normals, then the cut of every hyperplane from the
+    // xor of the packed sides of the two ends of each edge
+    sides.resize(n);
+    size_t n_chunks = (n + ROUND_CHUNK - 1) / ROUND_CHUNK;
+    std::vector<int64_t> chunk_cuts(n_chunks * ROUNDS_PER_BATCH, 0);
+    parallel_for(n_chunks, n_threads, [&](size_t c)
+    {
+        int begin = c * ROUND_CHUNK, end = std::min(n, begin + ROUND_CHUNK);
+        double dot[ROUNDS_PER_BATCH];
+        for(int v = begin; v < end; ++v)
+        {
+            const double* x = &vectors[size_t(v) * rank];
+            std::fill(dot, dot + ROUNDS_PER_BATCH, 0.0);
+            for(int k = 0; k < rank; ++k)
+            {
+                const double* r = &normals[size_t(k) * ROUNDS_PER_BATCH];
+                for(int t = 0; t < ROUNDS_PER_BATCH; ++t)
+                    dot[t] += x[k] * r[t];
+            }
+            uint64_t bits = 0;
+            for(int t = 0; t < ROUNDS_PER_BATCH; ++t)
+                bits |= uint64_t(dot[t] >= 0 ? 1 : 0) << t;
+            sides[v] = bits;
+        }
+    });
+    parallel_for(n_chunks, n_threads, [&](size_t c)
+    {
+        int begin = c * ROUND_CHUNK, end = std::min(n, begin + ROUND_CHUNK);
+        int64_t* cut = &chunk_cuts[c * ROUNDS_PER_BATCH];
+        for(int v = begin; v < end; ++v)
+            for(const Neighbor* it = adj[v].begin(); it != adj[v].end(); ++it)
+            {
+                if(it->v >= v)  continue;
+                for(uint64_t diff = sides[v] ^ sides[it->v]; diff != 0; diff &= diff - 1)
+                    cut[ __builtin_ctzll(diff) ] += it->w;
+            }
+    });
+    cuts.assign(count, 0);
+    for(size_t c = 0; c < n_chunks; ++c)
+        for(int t = 0; t < count; ++t)
+            cuts[t] += chunk_cuts[c * ROUNDS_PER_BATCH + t];
+}
+
+}// anonymous namespace
+
+MaxCut::MaxCut(int threshold/* = 15 */):
+    small_threshold(threshold), n_threads(1), bb_seconds(0), bb_max_nodes(80),
+    refine_passes(0), refine_seconds(0),
+    sdp_max_nodes(0), sdp_min_iter(100), sdp_max_iter(10000), sdp_min_ratio(0.878), sdp_max_ratio(0.995),
+    seed(0), value(0), upper_bound(0), sdp_value(0)
+{}
+
 void MaxCut::clear()
 {
-    for(std::vector<std::vector<size_t>* >::iterator it = graph.begin(); it != graph.end(); ++it)
-        delete (*it);
     node_relabel.clear();
     edge_list.clear();
-    graph.clear();
+    adj_offsets.clear();
+    adj_edges.clear();
     solution.clear();
+    value = upper_bound = sdp_value = 0;
 }
 
 void MaxCut::set_small_threshold(int threshold)
@@ -27,17 +572,42 @@ void MaxCut::set_small_threshold(int threshold)
     small_threshold = threshold;
 }
 
+void MaxCut::set_n_threads(int threads)
+{
+    n_threads = threads;
+}
+
+void MaxCut::set_branch_and_bound(double seconds, int max_nodes/* = 80*/)
+{
+    bb_seconds = seconds;
+    bb_max_nodes = max_nodes;
+}
+
+void MaxCut::set_refinement(int max_passes, double seconds/* = 0*/)
+{
+    refine_passes = max_passes;
+    refine_seconds = seconds;
+}
+
+void MaxCut::set_sdp(int max_nodes, int min_iter/* = 100*/, int max_iter/* = 10000*/,
+        double min_ratio/* = 0.878*/, double max_ratio/* = 0.995*/)
+{
+    sdp_max_nodes = max_nodes;
+    sdp_min_iter = min_iter;
+    sdp_max_iter = max_iter;
+    sdp_min_ratio = min_ratio;
+    sdp_max_ratio = max_ratio;
+}
+
+void MaxCut::set_seed(uint64_t s)
+{
+    seed = s;
+}
+
 void MaxCut::add_edge(int u, int v, int w)
 {
     int uu = node_relabel.add_raw_id(u);
     int vv = node_relabel.add_raw_id(v);
-    size_t edge_size = edge_list.size();
-
-    if(graph.size() <= uu)  graph.push_back( new std::vector<size_t>(1, edge_size) );
-    else    graph[ uu ]->push_back( edge_size );
-    if(graph.size() <= vv)  graph.push_back( new std::vector<size_t>(1, edge_size));
-    else    graph[ vv ]->push_back( edge_size );
-
     edge_list.push_back( OneEdge(uu, vv, w));
 }
 
@@ -84,42 +654,111 @@ double MaxCut::get_value() const
     return value;
 }
 
+double MaxCut::get_upper_bound() const
+{
+    return upper_bound;
+}
+
+double MaxCut::get_sdp_value() const
+{
+    return sdp_value;
+}
+
 bool MaxCut::solve()
 {
-    if( is_bipartite() )    return true;
-    if(exact_algorithm())   return true;
+    // the reductions of solve_reduced() may give edges of negative weight,
+    // which a bipartite graph must not cut
+    bool has_negative = false;
+    double total = 0, positive = 0;
+    for(size_t i = 0; i < edge_list.size(); ++i)
+    {
+        has_negative = has_negative || (edge_list[i].w < 0);
+        if(edge_list[i].u != edge_list[i].v)
+        {
+            total += edge_list[i].w;
+            positive += std::max(edge_list[i].w, 0);
+        }
+    }
+    if(! has_negative && is_bipartite())
+    {
+        value = upper_bound = total;
+        return true;
+    }
+    if(exact_algorithm())
+    {
+        upper_bound = value;
+        return true;
+    }
+    // no cut is better than all the positive edges, unless a solver below knows better
+    upper_bound = positive;
+    bool optimal;
+    if(solve_reduced(optimal))  return optimal;
+    if(split_blocks() > 1)  return solve_blocks();
     max_spanning_tree();
+    refine();
+    if(branch_and_bound())  return true;
+    if(int(node_relabel.size()) <= sdp_max_nodes)
+        low_rank_sdp();
     return false;
 }
 
 bool MaxCut::is_bipartite()
+{
+    build_adjacency(NULL);
+    return two_color();
+}
+
+void MaxCut::build_adjacency(const std::vector<size_t>* edges)
+{
+    // counting sort of the edge ends by node, each list in the order of the edges
+    int n = node_relabel.size();
+    size_t m = (edges ? edges->size() : edge_list.size());
+    adj_offsets.assign(n + 1, 0);
+    for(size_t k = 0; k < m; ++k)
+    {
+        const OneEdge& e = edge_list[ edges ? (*edges)[k] : k ];
+        ++adj_offsets[e.u + 1];
+        ++adj_offsets[e.v + 1];
+    }
+    for(int i = 0; i < n; ++i)
+        adj_offsets[i + 1] += adj_offsets[i];
+    adj_fill.assign(adj_offsets.begin(), adj_offsets.end() - 1);
+    adj_edges.resize(adj_offsets[n]);
+    for(size_t k = 0; k < m; ++k)
+    {
+        size_t j = (edges ? (*edges)[k] : k);
+        adj_edges[ adj_fill[ edge_list[j].u ]++ ] = j;
+        adj_edges[ adj_fill[ edge_list[j].v ]++ ] = j;
+    }
+}
+
+bool MaxCut::two_color()
 {
     int n = node_relabel.size();
     solution.assign(n, false);
-    std::vector<bool> node_visisted(n, false);
-    std::vector<int> node_queue;
+    visited.assign(n, 0);
+    node_stack.clear();
     for(int i = 0; i < n; ++i)
     {
-        if(node_visisted[i])    continue;
-        node_visisted[i] = true;
-        node_queue.push_back( i );
-        while(!node_queue.empty())
+        if(visited[i])  continue;
+        visited[i] = 1;
+        node_stack.push_back( i );
+        while(! node_stack.empty())
         {
-            int cur = node_queue.back();
-            node_queue.pop_back();
+            int cur = node_stack.back();
+            node_stack.pop_back();
 
-            for(std::vector<size_t>::iterator eit = graph[cur]->begin();
-                    eit != graph[cur]->end(); ++eit)
+            for(size_t k = adj_offsets[cur]; k < adj_offsets[cur + 1]; ++k)
             {
-                int t = edge_list[*eit].the_other_node( cur );
-                if(node_visisted[t])
+                int t = edge_list[ adj_edges[k] ].the_other_node( cur );
+                if(visited[t])
                 {
                     if(solution[cur] == solution[t])    return false;
                 }
                 else
                 {
-                    node_visisted[t] = true;
-                    node_queue.push_back( t );
+                    visited[t] = 1;
+                    node_stack.push_back( t );
                     solution[t] = !solution[cur];
                 }
             }
@@ -128,36 +767,78 @@ bool MaxCut::is_bipartite()
     return true;
 }
 
+// Node 0 stays on the false side; bit i of a mask is the side of node i+1.
+// The masks are enumerated in Gray code order, so that two consecutive masks
+// differ by the side of one node and the cut value is updated from its edges.
 bool MaxCut::exact_algorithm()
 {
     int N = node_relabel.size();
-    if(N > small_threshold) return false;
+    if(N > small_threshold || N > 64) return false;
     solution.assign(N, false);
     if(N == 1)  return true;
     if(N == 2)
     {
-        solution[1] = true;
+        int64_t w = 0;
+        for(size_t j = 0; j < edge_list.size(); ++j)
+            if(edge_list[j].u != edge_list[j].v)
+                w += edge_list[j].w;
+        solution[1] = (w > 0);
+        value = std::max<int64_t>(w, 0);
         return true;
     }
 
-    int n = 1 << (N - 1);
-    value = -1e10;
-    int max_sol = 0;
-    for(int i = 0; i < n; ++i)
+    merged.build(N, edge_list);
+    const MergedAdjacency& adj = merged;
+
+    const int bits = N - 1;
+    const int split = (n_threads > 1 && bits >= MIN_PARALLEL_BITS ? PARALLEL_SPLIT_BITS : 0);
+    const int low_bits = bits - split;
+    const uint64_t n_tasks = uint64_t(1) << split;
+    const uint64_t n_low = uint64_t(1) << low_bits;
+    std::vector<BestCut> best(n_tasks);
+    parallel_for(n_tasks, n_threads, [&](size_t t)
     {
-        double tmp_value = 0;
-        for(size_t j = 0; j < edge_list.size(); ++j)
-            if ( (!( (1<<edge_list[j].u) & (i<<1) )) ^ (!( (1 << edge_list[j].v) & (i<<1))))
-                tmp_value += edge_list[j].w;
-        if(tmp_value > value)
+        uint64_t mask = uint64_t(t) << low_bits;
+        int64_t cut = 0;
+        for(int u = 1; u < N; ++u)
+            for(size_t k = 0; k < adj[u].size(); ++k)
+            {
+                int v = adj[u][k].v;
+                bool side_u = (mask >> (u - 1)) & 1, side_v = (v > 0 && ((mask >> (v - 1)) & 1));
+                if(v < u && side_u != side_v)
+                    cut += adj[u][k].w;
+            }
+        BestCut& b = best[t];
+        b.value = cut;
+        b.mask = mask;
+        for(uint64_t i = 1; i != n_low; ++i)
         {
-            value = tmp_value;
-            max_sol = i;
+            int bit = __builtin_ctzll(i);
+            int x = bit + 1;
+            bool side_x = (mask >> bit) & 1;
+            int64_t delta = 0;
+            for(const Neighbor* it = adj[x].begin(); it != adj[x].end(); ++it)
+            {
+                bool side_y = (it->v > 0 && ((mask >> (it->v - 1)) & 1));
+                delta += (side_x == side_y ? it->w : -it->w);
+            }
+            mask ^= uint64_t(1) << bit;
+            cut += delta;
+            if(b.improved_by(cut, mask))
+            {
+                b.value = cut;
+                b.mask = mask;
+            }
         }
-    }
-    max_sol <<= 1;
-    for(int i = 0; i < N; ++i)
-        solution[i] = (1 << i) & max_sol;
+    });
+
+    BestCut result = best[0];
+    for(size_t t = 1; t < best.size(); ++t)
+        if(result.improved_by(best[t].value, best[t].mask))
+            result = best[t];
+    value = result.value;
+    for(int i = 1; i < N; ++i)
+        solution[i] = (result.mask >> (i - 1)) & 1;
     return true;
 }
 
@@ -166,9 +847,8 @@ void MaxCut::max_spanning_tree()
     int N = node_relabel.size();
 
     sort(edge_list.begin(), edge_list.end());
-    std::vector<int> union_set(N, -1);
-    for(std::vector<std::vector<size_t>* >::iterator it = graph.begin(); it != graph.end(); ++it)
-        (*it)->clear();
+    union_set.assign(N, -1);
+    tree_edges.clear();
     for(size_t i = 0; i < edge_list.size(); ++i)
     {
         int root_u = find_root(union_set, edge_list[i].u);
@@ -176,11 +856,11 @@ void MaxCut::max_spanning_tree()
         if(root_u != root_v)
         {
             union_set[root_u] = root_v;
-            graph[ edge_list[i].u ]->push_back( i );
-            graph[ edge_list[i].v ]->push_back( i );
+            tree_edges.push_back( i );
         }
     }
-    is_bipartite();
+    build_adjacency(&tree_edges);
+    two_color();
     value = 0;
     for(size_t i = 0; i < edge_list.size(); ++i)
     {
@@ -189,6 +869,468 @@ void MaxCut::max_spanning_tree()
     }
 }
 
+void MaxCut::refine()
+{
+    int N = node_relabel.size();
+    if(refine_passes <= 0 || solution.size() != size_t(N))  return;
+    merged.build(N, edge_list);
+    const MergedAdjacency& adj = merged;
+    std::vector<char> side(solution.begin(), solution.end());
+    improve_by_flips(adj, side);
+
+    int64_t max_gain = 0;
+    for(int v = 0; v < N; ++v)
+    {
+        int64_t degree = 0;
+        for(const Neighbor* it = adj[v].begin(); it != adj[v].end(); ++it)
+            degree += std::abs(it->w);
+        max_gain = std::max(max_gain, degree);
+    }
+    if(2 * max_gain + 1 <= MAX_GAIN_BUCKETS)
+    {
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for(int pass = 0; pass < refine_passes; ++pass)
+        {
+            if(fm_pass(adj, max_gain, side, fm_buffers) == 0)   break;
+            if(refine_seconds > 0 &&
+                    std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() > refine_seconds)
+                break;
+        }
+    }
+
+    int64_t cut = cut_value(adj, side);
+    if(cut > value)
+    {
+        solution.assign(side.begin(), side.end());
+        value = cut;
+    }
+}
+
+bool MaxCut::branch_and_bound()
+{
+    int N = node_relabel.size();
+    if(bb_seconds <= 0 || N > bb_max_nodes) return false;
+    merged.build(N, edge_list);
+    const MergedAdjacency& adj = merged;
+    solution.resize(N, false);
+    int64_t best, upper;
+    bool optimal = BranchAndBound(adj).run(solution, bb_seconds, best, upper);
+    value = best;
+    upper_bound = upper;
+    return optimal;
+}
+
+void MaxCut::low_rank_sdp()
+{
+    low_rank_sdp(sdp_min_iter, sdp_max_iter, sdp_min_ratio, sdp_max_ratio);
+}
+
+void MaxCut::low_rank_sdp(int min_iter, int max_iter, double min_ratio, double max_ratio)
+{
+    int N = node_relabel.size();
+    merged.build(N, edge_list);
+    const MergedAdjacency& adj = merged;
+    LowRankSdp sdp(adj);
+    sdp_value = sdp.solve(seed);
+
+    // the hyperplane of trial t is drawn from seed t, so that the result does
+    // not depend on the number of threads
+    std::vector<int64_t> cuts;
+    std::vector<uint64_t> sides;
+    std::vector<char> best_side;
+    int64_t best = 0;
+    int trials = 0;
+    while(trials < min_iter || (best < min_ratio * sdp_value && trials < max_iter))
+    {
+        int batch = std::min(ROUNDS_PER_BATCH, std::max(min_iter, max_iter) - trials);
+        if(batch <= 0)  break;
+        sdp.round(mix_seed(seed) + trials, batch, n_threads, sides, cuts);
+        for(int t = 0; t < batch; ++t)
+        {
+            if(best_side.empty() || cuts[t] > best)
+            {
+                best = cuts[t];
+                best_side.resize(N);
+                for(int v = 0; v < N; ++v)
+                    best_side[v] = (sides[v] >> t) & 1;
+            }
+        }
+        trials += batch;
+        if(best >= max_ratio * sdp_value)
+            break;
+    }
+    if(best_side.empty())   return;
+
+    improve_by_flips(adj, best_side);
+    best = cut_value(adj, best_side);
+    if(solution.size() != size_t(N) || best > value)
+    {
+        solution.assign(best_side.begin(), best_side.end());
+        value = best;
+    }
+}
+
+uint64_t MaxCut::fingerprint(uint64_t* check/* = NULL*/) const
+{
+    GraphHash hash;
+    hash.add(uint64_t(node_relabel.size()));
+    for(std::vector<OneEdge>::const_iterator it = edge_list.begin(); it != edge_list.end(); ++it)
+    {
+        hash.add(it->u);
+        hash.add(it->v);
+        hash.add(it->w);
+    }
+    hash.add(small_threshold);
+    hash.add(refine_passes);
+    hash.add(refine_seconds);
+    hash.add(bb_seconds);
+    hash.add(bb_max_nodes);
+    hash.add(sdp_max_nodes);
+    hash.add(sdp_min_iter);
+    hash.add(sdp_max_iter);
+    hash.add(sdp_min_ratio);
+    hash.add(sdp_max_ratio);
+    hash.add(seed);
+    if(check)   *check = hash.second.value;
+    return hash.first.value;
+}
+
+void MaxCut::copy_settings(MaxCut& other) const
+{
+    other.set_small_threshold(small_threshold);
+    other.set_n_threads(n_threads);
+    other.set_refinement(refine_passes, refine_seconds);
+    other.set_branch_and_bound(bb_seconds, bb_max_nodes);
+    other.set_sdp(sdp_max_nodes, sdp_min_iter, sdp_max_iter, sdp_min_ratio, sdp_max_ratio);
+    other.set_seed(seed);
+}
+
+int MaxCut::find_pair(int u, int v)
+{
+    if(u > v)   std::swap(u, v);
+    const size_t mask = pair_table.size() - 1;
+    for(size_t k = mix_seed( (uint64_t(u) << 32) | uint32_t(v) ) & mask; ; k = (k + 1) & mask)
+    {
+        int p = pair_table[k];
+        if(p < 0)
+        {
+            NodePair np = {u, v, 0, pair_head[u], pair_head[v]};
+            p = pair_table[k] = pair_head[u] = pair_head[v] = int(pairs.size());
+            pairs.push_back(np);
+            return p;
+        }
+        if(pairs[p].u == u && pairs[p].v == v)
+            return p;
+    }
+}
+
+bool MaxCut::solve_reduced(bool& optimal)
+{
+    int N = node_relabel.size();
+    // at most one pair per edge and one per removed node, in a table at most half full
+    size_t table_size = 1;
+    while(table_size < 2 * (edge_list.size() + N))
+        table_size <<= 1;
+    pair_table.assign(table_size, -1);
+    pair_head.assign(N, -1);
+    pairs.clear();
+    for(size_t j = 0; j < edge_list.size(); ++j)
+        if(edge_list[j].u != edge_list[j].v)
+            pairs[ find_pair(edge_list[j].u, edge_list[j].v) ].w += edge_list[j].w;
+    pair_degree.assign(N, 0);
+    for(size_t p = 0; p < pairs.size(); ++p)
+    {
+        if(pairs[p].w == 0) continue;
+        ++pair_degree[ pairs[p].u ];
+        ++pair_degree[ pairs[p].v ];
+    }
+
+    // A node x of neighbors a and b adds max(0, wa + wb) to the cut if a and b
+    // are on the same side and max(wa, wb) if not, so it is replaced by an
+    // edge (a, b) of weight max(wa, wb) - max(0, wa + wb). A node with one
+    // neighbor a adds max(0, wa) whatever side a is on.
+    removed.clear();
+    std::vector<char>& gone = visited;
+    std::vector<int>& queue = node_stack;
+    gone.assign(N, 0);
+    queue.clear();
+    for(int v = 0; v < N; ++v)
+        if(pair_degree[v] <= 2)
+            queue.push_back(v);
+    while(! queue.empty())
+    {
+        int x = queue.back();
+        queue.pop_back();
+        if(gone[x] || pair_degree[x] > 2)   continue;
+        RemovedNode r = {x, -1, -1, 0, 0};
+        for(int p = pair_head[x]; p >= 0; p = (pairs[p].u == x ? pairs[p].next_u : pairs[p].next_v))
+        {
+            if(pairs[p].w == 0) continue;
+            int y = (pairs[p].u == x ? pairs[p].v : pairs[p].u);
+            if(r.a < 0) { r.a = y;  r.wa = pairs[p].w; }
+            else        { r.b = y;  r.wb = pairs[p].w; }
+            pairs[p].w = 0;
+            --pair_degree[y];
+        }
+        if(r.b >= 0 && r.b < r.a)   // the neighbors in increasing order
+        {
+            std::swap(r.a, r.b);
+            std::swap(r.wa, r.wb);
+        }
+        pair_degree[x] = 0;
+        gone[x] = 1;
+        removed.push_back(r);
+        if(r.b >= 0)
+        {
+            int64_t w = std::max(r.wa, r.wb) - std::max<int64_t>(0, r.wa + r.wb);
+            NodePair& ab = pairs[ find_pair(r.a, r.b) ];
+            int change = (ab.w == 0 ? 1 : 0);
+            ab.w += w;
+            change -= (ab.w == 0 ? 1 : 0);
+            pair_degree[r.a] += change;
+            pair_degree[r.b] += change;
+            if(pair_degree[r.b] <= 2)   queue.push_back(r.b);
+        }
+        if(r.a >= 0 && pair_degree[r.a] <= 2)
+            queue.push_back(r.a);
+    }
+    if(removed.empty()) return false;
+
+    // the kernel gets its edges by increasing (u, v), so that its nodes are
+    // labeled as they are in the lists of neighbors
+    pair_order.clear();
+    for(size_t p = 0; p < pairs.size(); ++p)
+    {
+        if(pairs[p].w == 0) continue;
+        if(pairs[p].w > INT_MAX || pairs[p].w < INT_MIN)    return false;
+        pair_order.push_back(p);
+    }
+    std::sort(pair_order.begin(), pair_order.end(), [this](int p, int q)
+    {
+        return pairs[p].u < pairs[q].u || (pairs[p].u == pairs[q].u && pairs[p].v < pairs[q].v);
+    });
+    std::unique_ptr<MaxCut> kernel = take_solver(n_threads);
+    for(size_t k = 0; k < pair_order.size(); ++k)
+    {
+        const NodePair& np = pairs[ pair_order[k] ];
+        kernel->add_edge(np.u, np.v, int(np.w));
+    }
+    optimal = (kernel->number_of_edges() == 0 || kernel->solve());
+    // each removed node adds to the kernel cut what it adds to the best cut
+    upper_bound = kernel->get_upper_bound();
+    for(size_t k = 0; k < removed.size(); ++k)
+    {
+        const RemovedNode& r = removed[k];
+        if(r.b >= 0)
+            upper_bound += std::max<int64_t>(0, r.wa + r.wb);
+        else if(r.a >= 0)
+            upper_bound += std::max<int64_t>(0, r.wa);
+    }
+
+    // put the removed nodes back, the last removed first
+    solution.assign(N, false);
+    const std::vector<bool>& kernel_solution = kernel->get_solution();
+    for(size_t i = 0; i < kernel->number_of_nodes(); ++i)
+        solution[ kernel->get_node_rawid(i) ] = kernel_solution[i];
+    give_back(kernel);
+    for(size_t k = removed.size(); k-- > 0; )
+    {
+        const RemovedNode& r = removed[k];
+        if(r.a < 0)
+            solution[r.x] = false;
+        else if(r.b < 0)
+            solution[r.x] = (r.wa > 0 ? ! solution[r.a] : bool(solution[r.a]));
+        else
+        {
+            int64_t gain[2];
+            for(int s = 0; s < 2; ++s)
+                gain[s] = (s != solution[r.a] ? r.wa : 0) + (s != solution[r.b] ? r.wb : 0);
+            solution[r.x] = (gain[1] > gain[0]);
+        }
+    }
+
+    value = 0;
+    for(size_t i = 0; i < edge_list.size(); ++i)
+        if(solution[ edge_list[i].u ] != solution[ edge_list[i].v ])
+            value += edge_list[i].w;
+    return true;
+}
+
+size_t MaxCut::split_blocks()
+{
+    // Tarjan's algorithm on the edges, without recursion; a loop is in no block
+    int N = node_relabel.size();
+    build_adjacency(NULL);
+    const size_t NO_EDGE = size_t(-1);
+    disc.assign(N, -1);
+    low.assign(N, 0);
+    edge_stack.clear();
+    frames.clear();
+    block_offsets.assign(1, 0);
+    block_edges.clear();
+    int time = 0;
+    for(int root = 0; root < N; ++root)
+    {
+        if(disc[root] >= 0) continue;
+        disc[root] = low[root] = time++;
+        BlockFrame f = {root, NO_EDGE, adj_offsets[root]};
+        frames.push_back(f);
+        while(! frames.empty())
+        {
+            BlockFrame& top = frames.back();
+            int v = top.v;
+            if(top.next < adj_offsets[v + 1])
+            {
+                size_t e = adj_edges[top.next];
+                int u = edge_list[e].the_other_node(v);
+                ++top.next;
+                if(e == top.parent_edge || u == v)  continue;
+                if(disc[u] < 0)
+                {
+                    edge_stack.push_back(e);
+                    disc[u] = low[u] = time++;
+                    BlockFrame child = {u, e, adj_offsets[u]};
+                    frames.push_back(child);
+                }
+                else if(disc[u] < disc[v])
+                {
+                    edge_stack.push_back(e);
+                    low[v] = std::min(low[v], disc[u]);
+                }
+                continue;
+            }
+
+            size_t parent_edge = top.parent_edge;
+            frames.pop_back();
+            if(frames.empty())  break;
+            int p = frames.back().v;
+            low[p] = std::min(low[p], low[v]);
+            if(low[v] >= disc[p])   // p separates the edges above parent_edge from the rest
+            {
+                size_t e;
+                do
+                {
+                    e = edge_stack.back();
+                    edge_stack.pop_back();
+                    block_edges.push_back(e);
+                } while(e != parent_edge);
+                block_offsets.push_back( block_edges.size() );
+            }
+        }
+    }
+    return block_offsets.size() - 1;
+}
+
+std::unique_ptr<MaxCut> MaxCut::take_solver(int threads)
+{
+    std::unique_ptr<MaxCut> sub;
+    {
+        std::lock_guard<std::mutex> guard(spare_lock);
+        if(! spare_solvers.empty())
+        {
+            sub = std::move(spare_solvers.back());
+            spare_solvers.pop_back();
+        }
+    }
+    if(! sub)   sub.reset(new MaxCut(small_threshold));
+    sub->clear();
+    copy_settings(*sub);
+    sub->set_n_threads(threads);
+    return sub;
+}
+
+void MaxCut::give_back(std::unique_ptr<MaxCut>& sub)
+{
+    std::lock_guard<std::mutex> guard(spare_lock);
+    spare_solvers.push_back( std::move(sub) );
+}
+
+bool MaxCut::solve_blocks()
+{
+    // flipping all the nodes of a block does not change its cut, so the blocks
+    // are solved one by one and then flipped to agree on their cut nodes;
+    // a block of k edges has at most k + 1 nodes
+    const size_t n_blocks = block_offsets.size() - 1;
+    block_sides.resize(block_edges.size() + n_blocks);
+    block_n_sides.assign(n_blocks, 0);
+    block_optimal.assign(n_blocks, 0);
+    block_upper.assign(n_blocks, 0);
+    auto solve_block = [&](size_t b, int threads)
+    {
+        std::unique_ptr<MaxCut> sub = take_solver(threads);
+        for(size_t k = block_offsets[b]; k < block_offsets[b + 1]; ++k)
+        {
+            const OneEdge& e = edge_list[ block_edges[k] ];
+            sub->add_edge(e.u, e.v, e.w);
+        }
+        block_optimal[b] = sub->solve();
+        block_upper[b] = sub->get_upper_bound();
+        const std::vector<bool>& sol = sub->get_solution();
+        std::pair<int, bool>* sides = &block_sides[ block_offsets[b] + b ];
+        for(size_t i = 0; i < sub->number_of_nodes(); ++i)
+            sides[i] = std::make_pair(sub->get_node_rawid(i), bool(sol[i]));
+        block_n_sides[b] = sub->number_of_nodes();
+        give_back(sub);
+    };
+
+    // big blocks take all the threads in turn, then the small ones are
+    // shared out one thread each
+    block_order.resize(n_blocks);
+    for(size_t b = 0; b < n_blocks; ++b)
+        block_order[b] = b;
+    const size_t total = block_edges.size();
+    std::stable_sort(block_order.begin(), block_order.end(), [this](size_t a, size_t b)
+    {
+        return block_offsets[a + 1] - block_offsets[a] > block_offsets[b + 1] - block_offsets[b];
+    });
+    size_t n_big = 0;
+    while(n_threads > 1 && n_big < n_blocks &&
+            (block_offsets[ block_order[n_big] + 1 ] - block_offsets[ block_order[n_big] ]) * n_threads >= total)
+    {
+        solve_block(block_order[n_big], n_threads);
+        ++n_big;
+    }
+    parallel_for(n_blocks - n_big, n_threads, [&](size_t x)
+    {
+        solve_block(block_order[n_big + x], 1);
+    });
+
+    // a block is found after the blocks below its cut node, so in reverse order
+    // each block meets at most one node placed before: the one it hangs from
+    int N = node_relabel.size();
+    std::vector<char>& placed = visited;
+    placed.assign(N, 0);
+    solution.assign(N, false);
+    for(size_t b = n_blocks; b-- > 0; )
+    {
+        const std::pair<int, bool>* sides = &block_sides[ block_offsets[b] + b ];
+        bool flip = false;
+        for(size_t i = 0; i < block_n_sides[b]; ++i)
+        {
+            if(placed[ sides[i].first ])
+            {
+                flip = (solution[ sides[i].first ] != sides[i].second);
+                break;
+            }
+        }
+        for(size_t i = 0; i < block_n_sides[b]; ++i)
+        {
+            solution[ sides[i].first ] = (sides[i].second != flip);
+            placed[ sides[i].first ] = 1;
+        }
+    }
+
+    value = 0;
+    for(size_t i = 0; i < edge_list.size(); ++i)
+        if(solution[ edge_list[i].u ] != solution[ edge_list[i].v ])
+            value += edge_list[i].w;
+    // the blocks share no edge, so no cut is better than the best cuts of all of them
+    upper_bound = 0;
+    for(size_t b = 0; b < n_blocks; ++b)
+        upper_bound += block_upper[b];
+    return std::find(block_optimal.begin(), block_optimal.end(), 0) == block_optimal.end();
+}
+
 int MaxCut::find_root(std::vector<int>& union_set, int i)
 {
     if(union_set[i] == -1)  return i;
@@ -4,19 +4,123 @@
 /*
 if( the graph is bipartite )
     return the (-1, 1) labeling of the graph
+else if( the graph is small )
+    run the exact algorithm
+else if( some nodes have at most two neighbors )
+    remove them, keeping the cut by an edge between their neighbors, and
+    solve the remaining graph as above
+else if( the graph has several biconnected blocks )
+    solve each block as a graph, in parallel, and flip the blocks to agree
+    on their cut nodes
 else
-    if( the graph is small )
-        run the exact algorithm
-    else
-        run maximum spanning tree
+    run maximum spanning tree
+    improve it by local search
+    if( branch and bound is enabled and the graph is not too big )
+        improve it by branch and bound within the time budget
+    if( it is not optimal and the SDP is enabled for the graph size )
+        keep the better of it and the rounded low-rank SDP
 */
 
 #include <vector>
 #include <algorithm>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
 #include <relabel.h>
 
 namespace loon
 {
+// The adjacency of nodes [0, n) in CSR form, with parallel edges merged and
+// loops dropped; the neighbors of a node come in the order of their first edge.
+class MergedAdjacency
+{
+public:
+    struct Neighbor
+    {
+        int v;
+        int64_t w;
+    };
+    class Range
+    {
+    private:
+        const Neighbor *first, *last;
+    public:
+        Range(const Neighbor* f, const Neighbor* l): first(f), last(l) {}
+        const Neighbor* begin() const { return first; }
+        const Neighbor* end() const { return last; }
+        size_t size() const { return last - first; }
+        const Neighbor& operator[](size_t k) const { return first[k]; }
+    };
+private:
+    std::vector<size_t> offsets;
+    std::vector<Neighbor> neighbors;
+    std::vector<size_t> slot;   // where a neighbor of the node being merged is
+public:
+    size_t size() const { return (offsets.empty() ? 0 : offsets.size() - 1); }
+    Range operator[](size_t v) const
+    {
+        return Range(neighbors.data() + offsets[v], neighbors.data() + offsets[v + 1]);
+    }
+    // the edges have members u, v and w; the buffers are kept from call to call
+    template<class EdgeList>
+    void build(int n, const EdgeList& edges);
+};
+
+template<class EdgeList>
+void MergedAdjacency::build(int n, const EdgeList& edges)
+{
+    // counting sort of the edge ends by node, then each list is merged in place
+    offsets.assign(n + 1, 0);
+    for(size_t j = 0; j < edges.size(); ++j)
+    {
+        if(edges[j].u == edges[j].v)    continue;
+        ++offsets[ edges[j].u + 1 ];
+        ++offsets[ edges[j].v + 1 ];
+    }
+    for(int i = 0; i < n; ++i)
+        offsets[i + 1] += offsets[i];
+    slot.assign(offsets.begin(), offsets.end() - 1);
+    neighbors.resize(offsets[n]);
+    for(size_t j = 0; j < edges.size(); ++j)
+    {
+        int u = edges[j].u, v = edges[j].v;
+        if(u == v)  continue;
+        Neighbor nb_u = {v, edges[j].w}, nb_v = {u, edges[j].w};
+        neighbors[ slot[u]++ ] = nb_u;
+        neighbors[ slot[v]++ ] = nb_v;
+    }
+
+    const size_t NONE = size_t(-1);
+    slot.assign(n, NONE);
+    size_t out = 0;
+    for(int u = 0; u < n; ++u)
+    {
+        size_t first = offsets[u], last = offsets[u + 1];
+        offsets[u] = out;
+        for(size_t k = first; k < last; ++k)
+        {
+            size_t& s = slot[ neighbors[k].v ];
+            if(s == NONE || s < offsets[u])
+            {
+                s = out;
+                neighbors[out++] = neighbors[k];
+            }
+            else
+                neighbors[s].w += neighbors[k].w;
+        }
+    }
+    offsets[n] = out;
+    neighbors.resize(out);
+}
+
+// The buffers of the Fiduccia-Mattheyses passes of MaxCut::refine(), kept
+// from pass to pass; the buckets of `head` are all empty between two passes.
+struct FmBuffers
+{
+    std::vector<int> head, next, prev, moves;
+    std::vector<int64_t> gain, bucket_of;
+};
+
 class MaxCut
 {
 private:
@@ -39,18 +143,98 @@ private:
     };
     RelabelSmallPosInt<int, int> node_relabel;
     std::vector<OneEdge> edge_list;
-    std::vector<std::vector<size_t>* > graph;
+    // CSR adjacency: the edges of node i are adj_edges[adj_offsets[i], adj_offsets[i+1])
+    std::vector<size_t> adj_offsets;
+    std::vector<size_t> adj_edges;
     std::vector<bool> solution;
+    // buffers kept across clear(), so that a MaxCut can be reused for many graphs
+    std::vector<size_t> adj_fill, tree_edges;
+    std::vector<int> union_set, node_stack;
+    std::vector<char> visited;
+    MergedAdjacency merged;     // of exact_algorithm(), refine(), branch_and_bound() and low_rank_sdp()
+    FmBuffers fm_buffers;
+    // the graph of solve_reduced(): one record per pair of nodes, found by an
+    // open-addressing table and linked into the lists of both nodes
+    struct NodePair
+    {
+        int u, v;   // u < v
+        int64_t w;  // 0: no edge
+        int next_u, next_v; // the next pair in the list of u, of v; -1 at the end
+    };
+    struct RemovedNode
+    {
+        int x, a, b;    // a and b are -1 if x has fewer neighbors
+        int64_t wa, wb;
+    };
+    std::vector<NodePair> pairs;
+    std::vector<int> pair_table, pair_head, pair_degree, pair_order;
+    std::vector<RemovedNode> removed;
+    // the blocks of split_blocks(): the edges of block b are
+    // block_edges[block_offsets[b], block_offsets[b+1])
+    struct BlockFrame
+    {
+        int v;
+        size_t parent_edge, next;
+    };
+    std::vector<BlockFrame> frames;
+    std::vector<int> disc, low;
+    std::vector<size_t> edge_stack, block_offsets, block_edges, block_order;
+    // the sides solve_blocks() gets for block b start at block_sides[block_offsets[b] + b]
+    std::vector< std::pair<int, bool> > block_sides;
+    std::vector<size_t> block_n_sides;
+    std::vector<char> block_optimal;
+    std::vector<double> block_upper;
+    // sub-solvers of solve_reduced() and solve_blocks(), kept for the next graphs
+    std::vector< std::unique_ptr<MaxCut> > spare_solvers;
+    std::mutex spare_lock;
     int small_threshold;
+    int n_threads;
+    double bb_seconds;  // time budget of branch_and_bound(); <= 0 disables it
+    int bb_max_nodes;
+    int refine_passes;      // FM passes of refine(); <= 0 disables it
+    double refine_seconds;  // <= 0: no time limit
+    int sdp_max_nodes;  // low_rank_sdp() runs in solve() on graphs up to this size
+    int sdp_min_iter, sdp_max_iter;
+    double sdp_min_ratio, sdp_max_ratio;
+    uint64_t seed;
     double value;
+    double upper_bound;
+    double sdp_value;
 
     int find_root(std::vector<int>& union_set, int i);
+    // the CSR adjacency of the edges `edges`, or of all the edges if it is NULL
+    void build_adjacency(const std::vector<size_t>* edges);
+    // 2-color the nodes along the adjacency; false if an edge joins one color
+    bool two_color();
+    // the pair of nodes u and v, added with weight 0 if it is new
+    int find_pair(int u, int v);
+    // false if no node can be removed; `optimal` tells if the result is
+    bool solve_reduced(bool& optimal);
+    // the edges of each biconnected block, a block below a cut node first;
+    // returns the number of blocks
+    size_t split_blocks();
+    bool solve_blocks();
+    // a cleared sub-solver with the settings of this one, and its return
+    std::unique_ptr<MaxCut> take_solver(int threads);
+    void give_back(std::unique_ptr<MaxCut>& sub);
 public:
-    MaxCut(int threshold = 15); // threshold should be <= 30
-    ~MaxCut();
-    void clear();
-    void set_small_threshold(int threshold);// threshold should be <= 30
+    MaxCut(int threshold = 15); // threshold should be <= 64
+    void clear();   // keeps the settings and the allocated buffers
+    void set_small_threshold(int threshold);// threshold should be <= 64
+    void set_n_threads(int threads);    // threads of exact_algorithm()
+    void set_branch_and_bound(double seconds, int max_nodes = 80);
+    void set_refinement(int max_passes, double seconds = 0);
+    // rounding stops after min_iter hyperplanes once the cut reaches min_ratio
+    // of the SDP, after max_iter, or as soon as it reaches max_ratio
+    void set_sdp(int max_nodes, int min_iter = 100, int max_iter = 10000,
+            double min_ratio = 0.878, double max_ratio = 0.995);
+    void set_seed(uint64_t s);  // of the random choices of low_rank_sdp()
+    void copy_settings(MaxCut& other) const;    // all but the graph
     void add_edge(int u, int v, int w);
+    // FNV-1a hash of the relabeled edges, in the order they were added, and of
+    // the settings that change the cut (not n_threads); call it before solve().
+    // `check`, if given, gets a second hash of the same values, independent of it.
+    uint64_t fingerprint(uint64_t* check = NULL) const;
     size_t number_of_nodes() const;
     size_t number_of_edges() const;
     int get_edge_u(size_t i) const;
@@ -59,10 +243,22 @@ public:
     int get_node_rawid(size_t i) const;
     const std::vector<bool>& get_solution() const;
     double get_value() const;
+    double get_upper_bound() const; // after solve() or branch_and_bound(): no cut is better
+    double get_sdp_value() const;   // after low_rank_sdp()
     bool solve(); // return: true if optimal, false if not
     bool is_bipartite();
     bool exact_algorithm();
     void max_spanning_tree();
+    // move single nodes, then run Fiduccia-Mattheyses passes with gain buckets,
+    // until a local optimum or the budget; the cut never gets worse
+    void refine();
+    // start from the current solution; return true if the result is optimal
+    bool branch_and_bound();
+    // 0.878-approx algorithm of Goemans and Williamson on a low-rank SDP,
+    // rounded by n_threads threads; keeps the current solution if it is better
+    void low_rank_sdp();
+    // the same with the rounding limits of set_sdp() given for this call only
+    void low_rank_sdp(int min_iter, int max_iter, double min_ratio, double max_ratio);
 };
 
 }// namespace loon
@@ -0,0 +1,169 @@
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+#include <parallel.h>
+#include "maxcut_batch.h"
+
+namespace loon
+{
+
+MaxCutBatch::MaxCutBatch(int threshold/* = 15*/):
+    settings(threshold)
+{}
+
+/*static*/ MaxCut& MaxCutBatch::thread_graph(const MaxCut& settings, int n_threads)
+{
+    static thread_local MaxCut graph;
+    graph.clear();
+    settings.copy_settings(graph);
+    graph.set_n_threads(n_threads);
+    return graph;
+}
+
+/*static*/ void MaxCutBatch::solve_cached(MaxCut& graph, MaxCutCache& cache,
+        std::vector<bool>& solution, double& value, bool& optimal)
+{
+    // the key before solve(), which reorders the edges
+    uint64_t check = 0;
+    uint64_t key = (cache.is_open() ? graph.fingerprint(&check) : 0);
+    if(cache.is_open() && cache.find(key, check, graph.number_of_nodes(), solution, value, optimal))
+        return;
+    optimal = graph.solve();
+    solution = graph.get_solution();
+    value = graph.get_value();
+    if(cache.is_open())
+        cache.add(key, check, solution, value, optimal);
+}
+
+void MaxCutBatch::clear()
+{
+    graphs.clear();
+}
+
+MaxCut& MaxCutBatch::get_settings()
+{
+    return settings;
+}
+
+void MaxCutBatch::set_cache(const std::string& fname, bool all_cuts/* = false*/)
+{
+    if(fname.empty())
+        cache.close();
+    else
+        cache.open(fname, all_cuts);
+}
+
+size_t MaxCutBatch::add_graph(int ref_id)
+{
+    graphs.push_back( Graph() );
+    graphs.back().ref_id = ref_id;
+    graphs.back().value = 0;
+    graphs.back().optimal = false;
+    return graphs.size() - 1;
+}
+
+void MaxCutBatch::add_edge(size_t i, int u, int v, int w)
+{
+    Edge e = {u, v, w};
+    graphs[i].edges.push_back(e);
+}
+
+void MaxCutBatch::read(const std::string& graph_fname)
+{
+    std::ifstream fin( graph_fname.c_str() );
+    if(! fin.is_open()) throw std::runtime_error("maxcut_batch: cannot open file [" + graph_fname + "]");
+    size_t n_edges;
+    int ref_id;
+    while(fin >> n_edges >> ref_id)
+    {
+        Graph& g = graphs[ add_graph(ref_id) ];
+        g.edges.resize(n_edges);
+        for(size_t k = 0; k < n_edges; ++k)
+            fin >> g.edges[k].u >> g.edges[k].v >> g.edges[k].w;
+        if(! fin)
+            throw std::runtime_error("maxcut_batch: truncated graph in file [" + graph_fname + "]");
+    }
+    fin.close();
+}
+
+void MaxCutBatch::solve_graph(Graph& g, int n_threads)
+{
+    MaxCut& graph = thread_graph(settings, n_threads);
+    for(std::vector<Edge>::const_iterator it = g.edges.begin(); it != g.edges.end(); ++it)
+        graph.add_edge(it->u, it->v, it->w);
+    solve_cached(graph, cache, g.solution, g.value, g.optimal);
+    g.nodes.resize( graph.number_of_nodes() );
+    for(size_t i = 0; i < g.nodes.size(); ++i)
+        g.nodes[i] = graph.get_node_rawid(i);
+}
+
+void MaxCutBatch::solve(int n_threads/* = 1*/)
+{
+    std::vector<size_t> order(graphs.size());
+    size_t total = 0;
+    for(size_t i = 0; i < graphs.size(); ++i)
+    {
+        order[i] = i;
+        total += graphs[i].edges.size();
+    }
+    std::stable_sort(order.begin(), order.end(),
+            [this](size_t a, size_t b) { return graphs[a].edges.size() > graphs[b].edges.size(); });
+
+    size_t n_big = 0;
+    while(n_threads > 1 && n_big < order.size() && graphs[ order[n_big] ].edges.size() * n_threads >= total)
+    {
+        solve_graph(graphs[ order[n_big] ], n_threads);
+        ++n_big;
+    }
+    parallel_for(order.size() - n_big, n_threads, [&](size_t x)
+    {
+        solve_graph(graphs[ order[n_big + x] ], 1);
+    });
+    cache.flush();
+}
+
+void MaxCutBatch::write(const std::string& maxcut_fname) const
+{
+    std::ofstream fout( maxcut_fname.c_str() );
+    if(! fout.is_open())    throw std::runtime_error("maxcut_batch: cannot open file [" + maxcut_fname + "]");
+    for(std::vector<Graph>::const_iterator it = graphs.begin(); it != graphs.end(); ++it)
+    {
+        fout << it->nodes.size() << ' ' << it->ref_id << '\n';
+        for(size_t i = 0; i < it->nodes.size(); ++i)
+            fout << it->nodes[i] << ' ' << (it->solution[i] ? 1 : 0) << '\n';
+    }
+    if(! fout)  throw std::runtime_error("maxcut_batch: failed to write file [" + maxcut_fname + "]");
+    fout.close();
+}
+
+size_t MaxCutBatch::size() const
+{
+    return graphs.size();
+}
+
+int MaxCutBatch::get_ref_id(size_t i) const
+{
+    return graphs[i].ref_id;
+}
+
+const std::vector<int>& MaxCutBatch::get_nodes(size_t i) const
+{
+    return graphs[i].nodes;
+}
+
+const std::vector<bool>& MaxCutBatch::get_solution(size_t i) const
+{
+    return graphs[i].solution;
+}
+
+double MaxCutBatch::get_value(size_t i) const
+{
+    return graphs[i].value;
+}
+
+bool MaxCutBatch::is_optimal(size_t i) const
+{
+    return graphs[i].optimal;
+}
+
+}// namespace loon
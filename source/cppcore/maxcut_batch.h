@@ -0,0 +1,82 @@
+#ifndef __CORE_MAXCUT_BATCH_H
+#define __CORE_MAXCUT_BATCH_H
+
+/*
+The max-cuts of many graphs, one per reference, solved together
+
+The graphs are added in memory or read from a graph_file, and solved on
+n_threads threads, the largest first. A graph that holds a thread's share
+of the edges gets all the threads by itself. The results stay in the order
+the graphs were added, and are written in the format of graph_cut.
+
+thread_graph() and solve_cached() are the steps of solving one graph, shared
+with InvDector::report() and InvDector::stream_report().
+*/
+
+#include <string>
+#include <vector>
+#include "maxcut.h"
+#include "maxcut_cache.h"
+
+namespace loon
+{
+
+class MaxCutBatch
+{
+private:
+    struct Edge
+    {
+        int u, v, w;
+    };
+    struct Graph
+    {
+        int ref_id;
+        std::vector<Edge> edges;
+        std::vector<int> nodes;     // raw ids, in the order of `solution`
+        std::vector<bool> solution;
+        double value;
+        bool optimal;
+    };
+    std::vector<Graph> graphs;
+    MaxCut settings;    // holds the solver settings of all the graphs
+    MaxCutCache cache;
+
+    MaxCutBatch(const MaxCutBatch&);
+    MaxCutBatch& operator=(const MaxCutBatch&);
+
+    void solve_graph(Graph& g, int n_threads);
+public:
+    MaxCutBatch(int threshold = 15);
+    // the MaxCut of the calling thread, cleared and given the settings of
+    // `settings` and n_threads, so that its buffers are reused from graph to graph
+    static MaxCut& thread_graph(const MaxCut& settings, int n_threads);
+    // the cut of `graph`, whose edges are added: from `cache` if it is open and
+    // has it, or else solved and added to the cache; by the nodes of `graph`
+    static void solve_cached(MaxCut& graph, MaxCutCache& cache,
+            std::vector<bool>& solution, double& value, bool& optimal);
+    void clear();
+    // the settings are the ones of MaxCut; its graph is not used
+    MaxCut& get_settings();
+    // look up the cuts in the cache file `fname` before solving the graphs, and
+    // add the new ones to it at the end of solve(); "" closes the cache.
+    // Only the optimal cuts are cached, unless all_cuts (see maxcut_cache.h).
+    void set_cache(const std::string& fname, bool all_cuts = false);
+    size_t add_graph(int ref_id); // returns the index of the graph
+    void add_edge(size_t i, int u, int v, int w);
+    // append the graphs of a graph_file
+    void read(const std::string& graph_fname);
+    void solve(int n_threads = 1);
+    // write the solutions in the format of graph_cut
+    void write(const std::string& maxcut_fname) const;
+
+    size_t size() const;
+    int get_ref_id(size_t i) const;
+    const std::vector<int>& get_nodes(size_t i) const;
+    const std::vector<bool>& get_solution(size_t i) const;
+    double get_value(size_t i) const;
+    bool is_optimal(size_t i) const;
+};
+
+}// namespace loon
+
+#endif
@@ -0,0 +1,155 @@
+#include <fstream>
+#include <stdexcept>
+#include <cstring>
+#include <unistd.h>
+#include "maxcut_cache.h"
+
+namespace loon
+{
+
+/*static*/ const char MaxCutCache::magic[8] = {'I', 'N', 'V', 'D', 'M', 'C', '0', '2'};
+
+MaxCutCache::MaxCutCache():
+    all_cuts(false), has_header(false), has_tail(false), file_size(0)
+{}
+
+void MaxCutCache::open(const std::string& cache_fname, bool keep_all_cuts/* = false*/)
+{
+    close();
+    std::ifstream fin(cache_fname.c_str(), std::ios::binary | std::ios::ate);
+    uint64_t n_bytes = (fin.is_open() ? uint64_t(fin.tellg()) : 0);
+    if(n_bytes > 0)
+    {
+        char buf[sizeof(magic)];
+        fin.seekg(0);
+        if(! fin.read(buf, sizeof(magic)) || std::memcmp(buf, magic, sizeof(magic)) != 0)
+            throw std::runtime_error("maxcut_cache: file [" + cache_fname + "] is not a max-cut cache");
+        has_header = true;
+        file_size = sizeof(magic);
+    }
+
+    uint64_t head[5];
+    std::vector<uint64_t> sides;
+    while(has_header && n_bytes - file_size >= sizeof(head))
+    {
+        fin.read(reinterpret_cast<char*>(head), sizeof(head));
+        uint64_t n_nodes = head[2];
+        uint64_t n_words = n_nodes / 64 + (n_nodes % 64 != 0 ? 1 : 0);
+        if(n_words > (n_bytes - file_size - sizeof(head)) / sizeof(uint64_t))
+            break;
+        sides.resize(n_words);
+        if(! sides.empty())
+            fin.read(reinterpret_cast<char*>(&sides[0]), sides.size() * sizeof(uint64_t));
+        if(! fin)
+            throw std::runtime_error("maxcut_cache: failed to read file [" + cache_fname + "]");
+        file_size += sizeof(head) + sides.size() * sizeof(uint64_t);
+        std::unordered_map<uint64_t, Entry>::const_iterator old = entries.find(head[0]);
+        if(old != entries.end() && (old->second.optimal || head[4] == 0))
+            continue;
+        Entry& e = entries[ head[0] ];
+        e.check = head[1];
+        std::memcpy(&e.value, &head[3], sizeof(double));
+        e.optimal = (head[4] != 0);
+        e.solution.resize(n_nodes);
+        for(uint64_t i = 0; i < n_nodes; ++i)
+            e.solution[i] = (sides[i / 64] >> (i % 64)) & 1;
+    }
+    fname = cache_fname;
+    all_cuts = keep_all_cuts;
+    has_tail = (file_size < n_bytes);
+}
+
+void MaxCutCache::flush()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if(fname.empty() || added.empty())  return;
+    // drop the record cut short by an interrupted run, so that the new ones stay aligned
+    if(has_tail && ::truncate(fname.c_str(), file_size) != 0)
+        throw std::runtime_error("maxcut_cache: cannot truncate file [" + fname + "]");
+    has_tail = false;
+    std::ofstream fout(fname.c_str(), std::ios::binary | std::ios::app);
+    if(! fout.is_open())    throw std::runtime_error("maxcut_cache: cannot open file [" + fname + "]");
+    if(! has_header)
+    {
+        fout.write(magic, sizeof(magic));
+        file_size = sizeof(magic);
+    }
+
+    uint64_t head[5];
+    std::vector<uint64_t> sides;
+    for(std::vector<uint64_t>::const_iterator it = added.begin(); it != added.end(); ++it)
+    {
+        const Entry& e = entries[*it];
+        head[0] = *it;
+        head[1] = e.check;
+        head[2] = e.solution.size();
+        std::memcpy(&head[3], &e.value, sizeof(double));
+        head[4] = (e.optimal ? 1 : 0);
+        sides.assign((e.solution.size() + 63) / 64, 0);
+        for(size_t i = 0; i < e.solution.size(); ++i)
+            if(e.solution[i])
+                sides[i / 64] |= uint64_t(1) << (i % 64);
+        fout.write(reinterpret_cast<const char*>(head), sizeof(head));
+        if(! sides.empty())
+            fout.write(reinterpret_cast<const char*>(&sides[0]), sides.size() * sizeof(uint64_t));
+        file_size += sizeof(head) + sides.size() * sizeof(uint64_t);
+    }
+
+    if(! fout)  throw std::runtime_error("maxcut_cache: failed to write file [" + fname + "]");
+    fout.close();
+    has_header = true;
+    added.clear();
+}
+
+void MaxCutCache::close()
+{
+    flush();
+    fname.clear();
+    all_cuts = false;
+    entries.clear();
+    added.clear();
+    has_header = has_tail = false;
+    file_size = 0;
+}
+
+bool MaxCutCache::is_open() const
+{
+    return ! fname.empty();
+}
+
+size_t MaxCutCache::size() const
+{
+    return entries.size();
+}
+
+bool MaxCutCache::find(uint64_t key, uint64_t check, size_t n_nodes,
+        std::vector<bool>& solution, double& value, bool& optimal)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    std::unordered_map<uint64_t, Entry>::const_iterator it = entries.find(key);
+    if(it == entries.end() || it->second.check != check || it->second.solution.size() != n_nodes)
+        return false;
+    if(! it->second.optimal && ! all_cuts)
+        return false;
+    solution = it->second.solution;
+    value = it->second.value;
+    optimal = it->second.optimal;
+    return true;
+}
+
+void MaxCutCache::add(uint64_t key, uint64_t check, const std::vector<bool>& solution, double value, bool optimal)
+{
+    if(! optimal && ! all_cuts) return;
+    std::lock_guard<std::mutex> guard(lock);
+    std::unordered_map<uint64_t, Entry>::const_iterator old = entries.find(key);
+    if(old != entries.end() && (old->second.optimal || ! optimal))
+        return;
+    Entry& e = entries[key];
+    e.check = check;
+    e.solution = solution;
+    e.value = value;
+    e.optimal = optimal;
+    added.push_back(key);
+}
+
+}// namespace loon
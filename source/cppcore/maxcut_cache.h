@@ -0,0 +1,80 @@
+#ifndef __CORE_MAXCUT_CACHE_H
+#define __CORE_MAXCUT_CACHE_H
+
+/*
+On-disk cache of max-cut solutions (little-endian)
+
+    header      char magic[8] = "INVDMC02"
+    records     uint64 key          MaxCut::fingerprint() of the graph
+                uint64 check        the second hash of MaxCut::fingerprint()
+                uint64 n_nodes
+                double value
+                uint64 optimal      1 if solve() proved the cut optimal
+                uint64 sides[(n_nodes + 63) / 64]
+                    bit i % 64 of sides[i / 64] is the side of node i
+
+The records are appended when the cache is flushed, so that a rerun of the
+report stage on the same alignments does not solve its graphs again. A
+record cut short by an interrupted run is ignored, and overwritten by the
+next flush. Of two records with the same key, the first optimal one is
+kept, or else the first one. A record is only used if its check and its
+number of nodes match the graph too.
+
+By default only the cuts proven optimal are cached. With all_cuts, the cuts
+of the heuristics are cached as well; refine() and branch_and_bound() stop
+on a time budget, so such a cut is the one found by the run that cached it,
+and a rerun with the same options gets it back even if it would now find a
+better one.
+*/
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <unordered_map>
+#include <stdint.h>
+
+namespace loon
+{
+
+// find() and add() may be called by several threads at once.
+class MaxCutCache
+{
+private:
+    struct Entry
+    {
+        uint64_t check;
+        std::vector<bool> solution;
+        double value;
+        bool optimal;
+    };
+    std::string fname;
+    bool all_cuts;      // cache the cuts not proven optimal too
+    std::unordered_map<uint64_t, Entry> entries;
+    std::vector<uint64_t> added;    // the keys not written yet, in the order they were added
+    bool has_header;
+    bool has_tail;      // the file ends with a record cut short
+    uint64_t file_size; // bytes of the header and the whole records in the file
+    std::mutex lock;
+
+    MaxCutCache(const MaxCutCache&);
+    MaxCutCache& operator=(const MaxCutCache&);
+public:
+    static const char magic[8];
+
+    MaxCutCache();
+    // read the records of `fname`, which is created by flush() if it does not
+    // exist; all_cuts: also cache and use the cuts not proven optimal
+    void open(const std::string& fname, bool all_cuts = false);
+    void flush();   // append the records added since the last flush
+    void close();   // flush, then forget the records
+    bool is_open() const;
+    size_t size() const;
+    // false if `key` is not cached, or was cached for another check or number of nodes
+    bool find(uint64_t key, uint64_t check, size_t n_nodes,
+            std::vector<bool>& solution, double& value, bool& optimal);
+    void add(uint64_t key, uint64_t check, const std::vector<bool>& solution, double value, bool optimal);
+};
+
+}// namespace loon
+
+#endif
@@ -1,5 +1,8 @@
 #include <relabel.h>
+#include <parallel.h>
+#include <mapped_file.h>
 #include <stdexcept>
+#include <cstring>
 #include "region.h"
 
 #define DEBUG_SEG_EXTRACTION
@@ -10,24 +13,59 @@
 namespace loon
 {
 
-InvertedRepeats::InvertedRepeats(const std::string& filedir):
+InvertedRepeats::InvertedRepeats(const std::string& filedir/* = ""*/):
     prefix(filedir)
 {}
 
-void InvertedRepeats::parse_two_ints(const std::string& line)
+void InvertedRepeats::parse_two_ints(const char* p, const char* end)
 {
-    size_t i = 0;
     size_t num = 0;
-    while(line[i] >= '0' && line[i] <= '9')
-        num = num * 10 + line[i++] - '0';
+    while(p < end && *p >= '0' && *p <= '9')
+        num = num * 10 + *p++ - '0';
     r_starts.push_back( num - 1 );
 
-    num = 0;    ++i;
-    while(line[i] >= '0' && line[i] <= '9')
-        num = num * 10 + line[i++] - '0';
+    num = 0;    ++p;
+    while(p < end && *p >= '0' && *p <= '9')
+        num = num * 10 + *p++ - '0';
     r_ends.push_back( num );
 }
 
+namespace
+{
+
+// beginning of the line after the one starting at p
+inline const char* next_line(const char* p, const char* end)
+{
+    const char* q = static_cast<const char*>( std::memchr(p, '\n', end - p) );
+    return q ? q + 1 : end;
+}
+
+}// anonymous namespace
+
+void InvertedRepeats::parse_delta(const char* p, const char* end)
+{
+    clear();
+    p = next_line(p, end);  // the two sequence files
+    p = next_line(p, end);  // "NUCMER"
+    while(p < end)
+    {
+        if(*p == '>' || *p == '\n')   // header of a pair of sequences
+        {
+            p = next_line(p, end);
+            continue;
+        }
+        // header of an alignment: its reference range is all we need, so
+        // jump over the distances of its indels up to the closing "0"
+        parse_two_ints( p, end );
+        for(p = next_line(p, end); p < end && *p != '0'; p = next_line(p, end))
+            ;
+        p = next_line(p, end);
+    }
+    if(! r_starts.empty())
+        quicksort(0, r_starts.size() - 1);
+    build_index();
+}
+
 void InvertedRepeats::quicksort(long long L, long long R)
 {
     long long i = L, j = R;
@@ -71,7 +109,7 @@ std::string InvertedRepeats::compose_subdirectory(size_t n)
     return ret;    
 }
 
-void InvertedRepeats::open(size_t file_id)
+std::string InvertedRepeats::delta_file(size_t file_id)
 {
     std::ostringstream oss;
 #if defined(_WIN32) || defined(__CYGWIN__)
@@ -79,39 +117,37 @@ void InvertedRepeats::open(size_t file_id)
 #else
     oss << "/nc_aln." << file_id << ".delta";
 #endif
-    std::string fname = prefix + compose_subdirectory(file_id) + oss.str();
-    fin.open( fname.c_str() );
-    if(!fin.is_open())
+    return prefix + compose_subdirectory(file_id) + oss.str();
+}
+
+void InvertedRepeats::load(size_t file_id)
+{
+    std::string fname = delta_file(file_id);
+    MappedFile fin;
+    if(! fin.open(fname, MADV_SEQUENTIAL))
         throw std::runtime_error("region: cannot open file [" + fname + "]");
+    parse_delta(fin.data(), fin.data() + fin.size());
 }
 
-void InvertedRepeats::close()
+/*static*/ void InvertedRepeats::load_all(const std::string& filedir, size_t n_refs,
+        int n_threads, std::vector<InvertedRepeats>& repeats)
 {
-    fin.close();
+    repeats.assign(n_refs, InvertedRepeats(filedir));
+    parallel_for(n_refs, n_threads, [&repeats](size_t i) { repeats[i].load(i); });
 }
 
-void InvertedRepeats::read()
+void InvertedRepeats::assign(const uint64_t* starts, const uint64_t* ends, size_t n)
 {
-    clear();
-    std::string line;
-    getline(fin, line);
-    getline(fin, line);
-    while(getline(fin, line))
-    {
-        if(line[0] == '>')
-            continue;
-        parse_two_ints( line );
-        for(getline(fin, line); line[0] != '0'; getline(fin, line))
-            ;
-    }
-    if(! r_starts.empty())
-        quicksort(0, r_starts.size() - 1);
+    r_starts.assign(starts, starts + n);
+    r_ends.assign(ends, ends + n);
+    build_index();
 }
 
 void InvertedRepeats::clear()
 {
     r_starts.clear();
     r_ends.clear();
+    max_ends.clear();
 }
 
 size_t InvertedRepeats::size() const
@@ -119,21 +155,59 @@ size_t InvertedRepeats::size() const
     return r_starts.size();
 }
 
-bool InvertedRepeats::contained(size_t i, size_t j) const
+void InvertedRepeats::build_index()
 {
-    // to be improved
-    double uncovered_ratio = 1.0, tmp_ratio;
+    max_ends.resize( r_ends.size() );
+    for(size_t k = 0; k < r_ends.size(); ++k)
+        max_ends[k] = (k == 0 ? r_ends[k] : std::max(max_ends[k-1], r_ends[k]));
+}
+
+// `k` is the number of repeats starting at or before i
+bool InvertedRepeats::contained_from(size_t k, size_t i, size_t j) const
+{
+    // [i, j) is contained if some repeat leaves less than 0.1% of it uncovered
+    const double max_ratio = 0.001;
     size_t len = j - i;
-    size_t left_ext, right_ext;
-    for(size_t ii = 0; ii < r_starts.size(); ++ii)
+    if(len == 0)    return false;
+
+    // among the repeats starting at or before i, the one reaching farthest is the best
+    if(k > 0)
+    {
+        size_t right_ext = (j > max_ends[k-1] ? j - max_ends[k-1] : 0);
+        if(double(right_ext) / len < max_ratio)
+            return true;
+    }
+    // the other candidates start less than 0.1% of the length after i
+    size_t max_left_ext = size_t(len * max_ratio) + 1;
+    for(; k < r_starts.size() && r_starts[k] - i <= max_left_ext; ++k)
+    {
+        size_t left_ext = r_starts[k] - i;
+        size_t right_ext = (j > r_ends[k] ? j - r_ends[k] : 0);
+        if(double(left_ext + right_ext) / len < max_ratio)
+            return true;
+    }
+    return false;
+}
+
+bool InvertedRepeats::contained(size_t i, size_t j) const
+{
+    size_t k = std::upper_bound(r_starts.begin(), r_starts.end(), i) - r_starts.begin();
+    return contained_from(k, i, j);
+}
+
+void InvertedRepeats::contained(const std::vector<uint32_t>& starts,
+        const std::vector<uint32_t>& ends, std::vector<bool>& result) const
+{
+    result.resize( starts.size() );
+    size_t k = 0;
+    for(size_t q = 0; q < starts.size(); ++q)
     {
-        left_ext = right_ext = 0;
-        if(i < r_starts[ii])    left_ext = r_starts[ii] - i;
-        if(j > r_ends[ii])      right_ext = j - r_ends[ii];
-        tmp_ratio = double(left_ext + right_ext) / len;
-        if(tmp_ratio < uncovered_ratio) uncovered_ratio = tmp_ratio;
+        if(q > 0 && starts[q] < starts[q-1])    // not sorted: search again
+            k = std::upper_bound(r_starts.begin(), r_starts.end(), starts[q]) - r_starts.begin();
+        while(k < r_starts.size() && r_starts[k] <= starts[q])
+            ++k;
+        result[q] = contained_from(k, starts[q], ends[q]);
     }
-    return (uncovered_ratio < 0.001);
 }
 
 VertexPair::VertexPair():
@@ -175,11 +249,6 @@ bool VertexPair::operator<(const VertexPair& rhs) const
     return (u < rhs.u || (u == rhs.u && v < rhs.v));
 }
 
-void VertexPair::inc_weight() const
-{
-    ++const_cast<VertexPair*>(this)->w;
-}
-
 OneAln::OneAln(const std::string& qname, long long qlen,
         long long rstart, long long rend,
         long long qstart, long long qend,
@@ -189,15 +258,52 @@ OneAln::OneAln(const std::string& qname, long long qlen,
         q_start(qstart), q_end(qend),
         mapping_quality(mapQ), direction(dir)
 {
-    std::istringstream iss( qname.substr(qname.find("afun") + std::string("afun").length()) );
+    long long qrawlen;
+    parse_qname(qname.data(), qname.length(), q_id, q_pos, qrawlen);
 #ifdef FOR_NORA_EXAMINATION
-    char under_score;
-    iss >> q_id >> under_score >> q_pos >> under_score >> q_raw_len;
-#else
-    iss >> q_id >> q_pos >> q_pos;
+    q_raw_len = qrawlen;
+#endif
+}
+
+OneAln::OneAln(size_t qid, char qpos, long long qrawlen, long long qlen,
+        long long rstart, long long rend,
+        long long qstart, long long qend,
+        short mapQ, char dir):
+        q_id(qid), q_length(qlen),
+        r_start(rstart), r_end(rend),
+        q_start(qstart), q_end(qend),
+        mapping_quality(mapQ), direction(dir), q_pos(qpos)
+#ifdef FOR_NORA_EXAMINATION
+        , q_raw_len(qrawlen)
+#endif
+{
+#ifndef FOR_NORA_EXAMINATION
+    (void)qrawlen;  // only kept for the examination outputs
 #endif
 }
 
+/*static*/ void OneAln::parse_qname(const char* qname, size_t qname_len,
+        size_t& qid, char& qpos, long long& qrawlen)
+{
+    // read names look like "afun<q_id>_<q_pos>_<q_raw_len>[/...]" (c.f. peGenerator.py)
+    static const char tag[] = "afun";
+    const char* end = qname + qname_len;
+    const char* p = std::search(qname, end, tag, tag + 4);
+    if(p == end)
+        throw std::runtime_error("region: cannot parse query name [" + std::string(qname, qname_len) + "]");
+    p += 4;
+
+    qid = 0;
+    while(p < end && *p >= '0' && *p <= '9')
+        qid = qid * 10 + (*p++ - '0');
+    if(p < end) ++p;    // '_'
+    qpos = (p < end ? *p++ : '\0');
+    if(p < end) ++p;    // '_'
+    qrawlen = 0;
+    while(p < end && *p >= '0' && *p <= '9')
+        qrawlen = qrawlen * 10 + (*p++ - '0');
+}
+
 bool OneAln::is_forward() const
 {
     return direction == 'F';
@@ -213,23 +319,11 @@ bool OneAln::is_5end() const
     return q_pos == '5';
 }
 
-void OneAln::invalidate()
-{
-    q_length = -1;
-}
-
 bool OneAln::is_valid() const
 {
     return q_length > 0;
 }
 
-bool OneAln::operator<(const OneAln& rhs) const
-{
-    if(is_valid() && (r_start < rhs.r_start || 
-            (r_start == rhs.r_start && r_end > rhs.r_end)))   return true;
-    return false;
-}
-
 #ifdef FOR_NORA_EXAMINATION
 std::ostream& operator<<(std::ostream& out, const OneAln& obj)
 {
@@ -241,10 +335,217 @@ std::ostream& operator<<(std::ostream& out, const OneAln& obj)
 }
 #endif
 
+namespace
+{
+
+uint32_t to_uint32(long long x, const char* what)
+{
+    if(x < 0 || x > 0xFFFFFFFFLL)
+        throw std::runtime_error(std::string("region: ") + what + " does not fit in 32 bits");
+    return static_cast<uint32_t>(x);
+}
+
+template<class T>
+void gather(std::vector<T>& column, const std::vector<uint32_t>& order)
+{
+    std::vector<T> tmp( order.size() );
+    for(size_t i = 0; i < order.size(); ++i)
+        tmp[i] = column[ order[i] ];
+    column.swap( tmp );
+}
+
+// valid alignments ordered by r_start and then by decreasing r_end
+struct AlnSortKey
+{
+    uint32_t r_start, r_end;
+    uint32_t index;
+    bool valid;
+    // the invalid alignments last, so that gen_vertices() can cut them off
+    bool operator<(const AlnSortKey& rhs) const
+    {
+        if(valid != rhs.valid)  return valid;
+        return r_start < rhs.r_start ||
+                (r_start == rhs.r_start && r_end > rhs.r_end);
+    }
+};
+
+// u == v never occurs in an edge, so the all-ones key marks an empty slot
+const uint64_t EMPTY = ~uint64_t(0);
+
+// Open-addressing hash map from the packed key (u << 32 | v) of an edge to
+// its weight, with linear probing.
+class EdgeCounter
+{
+private:
+    std::vector<uint64_t> keys;
+    std::vector<size_t> weights;
+    size_t n_edges;
+    int shift;  // 64 - log2(number of slots)
+
+    size_t slot(uint64_t key) const
+    {
+        return (key * 0x9E3779B97F4A7C15ull) >> shift;
+    }
+
+    void grow()
+    {
+        std::vector<uint64_t> old_keys( keys.size() << 1, EMPTY );
+        std::vector<size_t> old_weights( keys.size() << 1, 0 );
+        old_keys.swap( keys );
+        old_weights.swap( weights );
+        --shift;
+        size_t mask = keys.size() - 1;
+        for(size_t i = 0; i < old_keys.size(); ++i)
+        {
+            if(old_keys[i] == EMPTY)    continue;
+            size_t j = slot( old_keys[i] );
+            while(keys[j] != EMPTY)
+                j = (j + 1) & mask;
+            keys[j] = old_keys[i];
+            weights[j] = old_weights[i];
+        }
+    }
+public:
+    EdgeCounter():
+        keys(64, EMPTY), weights(64, 0), n_edges(0), shift(64 - 6)
+    {}
+
+    void add(uint32_t u, uint32_t v)
+    {
+        if(v < u)   std::swap(u, v);
+        uint64_t key = (uint64_t(u) << 32) | v;
+        size_t mask = keys.size() - 1;
+        size_t j = slot( key );
+        while(keys[j] != EMPTY && keys[j] != key)
+            j = (j + 1) & mask;
+        if(keys[j] == EMPTY)
+        {
+            keys[j] = key;
+            ++n_edges;
+        }
+        ++weights[j];
+        if(n_edges * 2 > keys.size())
+            grow();
+    }
+
+    // the edges of weight > min_weight, ordered by (u, v)
+    void get_edges(std::vector<VertexPair>& edges, size_t min_weight) const
+    {
+        std::vector< std::pair<uint64_t, size_t> > found;
+        found.reserve( n_edges );
+        for(size_t i = 0; i < keys.size(); ++i)
+            if(keys[i] != EMPTY && weights[i] > min_weight)
+                found.push_back( std::make_pair(keys[i], weights[i]) );
+        std::sort( found.begin(), found.end() );
+        edges.resize( found.size() );
+        for(size_t i = 0; i < found.size(); ++i)
+            edges[i].set_uvw( found[i].first >> 32, found[i].first & 0xFFFFFFFFu, found[i].second );
+    }
+};
+
+// sort key of make_pairs(): read id, then 5' before 3', then alignment index
+struct PairKey
+{
+    uint64_t key;
+    uint32_t index;
+    bool operator<(const PairKey& rhs) const
+    {
+        return key < rhs.key || (key == rhs.key && index < rhs.index);
+    }
+};
+
+}// anonymous namespace
+
+size_t AlnStore::size() const
+{
+    return r_start.size();
+}
+
+void AlnStore::reserve(size_t n)
+{
+    q_id.reserve(n);        q_length.reserve(n);
+    r_start.reserve(n);     r_end.reserve(n);
+    q_start.reserve(n);     q_end.reserve(n);
+    mapping_quality.reserve(n);
+    direction.reserve(n);   q_pos.reserve(n);
+#ifdef FOR_NORA_EXAMINATION
+    q_raw_len.reserve(n);
+#endif
+}
+
+void AlnStore::clear()
+{
+    q_id.clear();       q_length.clear();
+    r_start.clear();    r_end.clear();
+    q_start.clear();    q_end.clear();
+    mapping_quality.clear();
+    direction.clear();  q_pos.clear();
+#ifdef FOR_NORA_EXAMINATION
+    q_raw_len.clear();
+#endif
+}
+
+void AlnStore::push_back(const OneAln& aln)
+{
+    if(aln.q_id > 0xFFFFFFFFu)
+        throw std::runtime_error("region: read id does not fit in 32 bits");
+    q_id.push_back( static_cast<uint32_t>(aln.q_id) );
+    q_length.push_back( aln.is_valid() ? to_uint32(aln.q_length, "read length") : 0 );
+    r_start.push_back( to_uint32(aln.r_start, "reference position") );
+    r_end.push_back( to_uint32(aln.r_end, "reference position") );
+    q_start.push_back( to_uint32(aln.q_start, "read position") );
+    q_end.push_back( to_uint32(aln.q_end, "read position") );
+    mapping_quality.push_back( aln.mapping_quality );
+    direction.push_back( aln.direction );
+    q_pos.push_back( aln.q_pos );
+#ifdef FOR_NORA_EXAMINATION
+    q_raw_len.push_back( to_uint32(aln.q_raw_len, "read length") );
+#endif
+}
 
+OneAln AlnStore::operator[](size_t i) const
+{
+#ifdef FOR_NORA_EXAMINATION
+    long long qrawlen = q_raw_len[i];
+#else
+    long long qrawlen = 0;
+#endif
+    return OneAln(q_id[i], q_pos[i], qrawlen, is_valid(i) ? (long long)q_length[i] : -1,
+            r_start[i], r_end[i], q_start[i], q_end[i],
+            mapping_quality[i], direction[i]);
+}
 
+bool AlnStore::is_forward(size_t i) const
+{
+    return direction[i] == 'F';
+}
 
+bool AlnStore::is_5end(size_t i) const
+{
+    return q_pos[i] == '5';
+}
+
+void AlnStore::invalidate(size_t i)
+{
+    q_length[i] = 0;
+}
+
+bool AlnStore::is_valid(size_t i) const
+{
+    return q_length[i] > 0;
+}
 
+void AlnStore::permute(const std::vector<uint32_t>& order)
+{
+    gather(q_id, order);        gather(q_length, order);
+    gather(r_start, order);     gather(r_end, order);
+    gather(q_start, order);     gather(q_end, order);
+    gather(mapping_quality, order);
+    gather(direction, order);   gather(q_pos, order);
+#ifdef FOR_NORA_EXAMINATION
+    gather(q_raw_len, order);
+#endif
+}
 
 void Region::add_ref_info(long long len, const std::string& name)
 {
@@ -252,12 +553,61 @@ void Region::add_ref_info(long long len, const std::string& name)
     r_name = name;
 }
 
+long long Region::get_length() const
+{
+    return r_length;
+}
+
+const std::string& Region::get_name() const
+{
+    return r_name;
+}
+
+size_t Region::size() const
+{
+    return regional_alns.size();
+}
+
+OneAln Region::operator[](size_t i) const
+{
+    return regional_alns[i];
+}
+
+void Region::reserve(size_t n)
+{
+    regional_alns.reserve(n);
+}
+
 void Region::push_back(const std::string& q_name, long long q_length, 
         long long r_start, long long r_end,
         long long q_start, long long q_end,
         short mapping_quality, char direction)
 {
-    regional_alns.push_back( OneAln(q_name, q_length,
+    push_back(q_name.data(), q_name.length(), q_length,
+            r_start, r_end, q_start, q_end,
+            mapping_quality, direction);
+}
+
+void Region::push_back(const char* q_name, size_t q_name_len, long long q_length,
+        long long r_start, long long r_end,
+        long long q_start, long long q_end,
+        short mapping_quality, char direction)
+{
+    size_t q_id;
+    char q_pos;
+    long long q_raw_len;
+    OneAln::parse_qname(q_name, q_name_len, q_id, q_pos, q_raw_len);
+    push_back(q_id, q_pos, q_raw_len, q_length,
+            r_start, r_end, q_start, q_end,
+            mapping_quality, direction);
+}
+
+void Region::push_back(size_t q_id, char q_pos, long long q_raw_len, long long q_length,
+        long long r_start, long long r_end,
+        long long q_start, long long q_end,
+        short mapping_quality, char direction)
+{
+    regional_alns.push_back( OneAln(q_id, q_pos, q_raw_len, q_length,
                                 r_start, r_end,
                                 q_start, q_end,
                                 mapping_quality, direction) );
@@ -269,8 +619,7 @@ void Region::clear()
     segs_start.clear();
     segs_end.clear();
     seg_ids.clear();
-    pair_5.clear();
-    pair_3.clear();
+    pair_alns.clear();
 }
 
 void Region::clear_name()
@@ -288,9 +637,9 @@ void Region::remove_low_coverage_reads(int min_cvg/* = 0*/, double min_cvg_perce
     double total_len = 0;
     for(size_t i = 0; i < nn; ++i)
     {
-        segEndpoints.push_back( SegEndpoint(i, regional_alns[i].r_start, true) );
-        segEndpoints.push_back( SegEndpoint(i, regional_alns[i].r_end, false) );
-        total_len += regional_alns[i].r_end - regional_alns[i].r_start;
+        segEndpoints.push_back( SegEndpoint(i, regional_alns.r_start[i], true) );
+        segEndpoints.push_back( SegEndpoint(i, regional_alns.r_end[i], false) );
+        total_len += double(regional_alns.r_end[i]) - double(regional_alns.r_start[i]);
     }
     min_cvg = std::max(min_cvg, int(total_len * min_cvg_percent / r_length));
     std::sort(segEndpoints.begin(), segEndpoints.end());
@@ -346,7 +695,7 @@ void Region::remove_low_coverage_reads(int min_cvg/* = 0*/, double min_cvg_perce
     for(size_t i = 0; i < nn; ++i)
     {
         size_t max_cvg = nn - rmq.query(q_segStart[i], q_segEnd[i]);
-        if(max_cvg < min_cvg)   regional_alns[i].invalidate();
+        if(max_cvg < size_t(min_cvg))   regional_alns.invalidate(i);
     }
 }
 
@@ -355,99 +704,130 @@ void Region::remove_low_coverage_reads(int min_cvg/* = 0*/, double min_cvg_perce
 #endif
 void Region::gen_vertices(int min_overlap)
 {
-    std::sort( regional_alns.begin(), regional_alns.end() );
-    for(size_t i = 0; i < regional_alns.size(); ++i)
+    // sort the alignments through compact keys, then reorder the columns once
+    size_t n = regional_alns.size();
+    std::vector<AlnSortKey> keys( n );
+    for(size_t i = 0; i < n; ++i)
     {
-        if(regional_alns[i].is_valid())
-        {
-            if(segs_start.empty() || segs_end.back() <= regional_alns[i].r_start + min_overlap)
-            {// new segment
-                segs_start.push_back( regional_alns[i].r_start );
-                segs_end.push_back( regional_alns[i].r_end );
-            }
-            else if(segs_end.back() < regional_alns[i].r_end)
-            {// update right-end
-                segs_end.back() = regional_alns[i].r_end;
-            }
-            seg_ids.push_back( segs_start.size() - 1 );
+        keys[i].r_start = regional_alns.r_start[i];
+        keys[i].r_end = regional_alns.r_end[i];
+        keys[i].index = i;
+        keys[i].valid = regional_alns.is_valid(i);
+    }
+    std::sort( keys.begin(), keys.end() );
+    std::vector<uint32_t> order;
+    order.reserve( n );
+    for(size_t i = 0; i < n && keys[i].valid; ++i)  // drop the invalid alignments
+        order.push_back( keys[i].index );
+    std::vector<AlnSortKey>().swap( keys );
+    regional_alns.permute( order );
+
+    const std::vector<uint32_t>& r_start = regional_alns.r_start;
+    const std::vector<uint32_t>& r_end = regional_alns.r_end;
+    seg_ids.reserve( order.size() );
+    for(size_t i = 0; i < order.size(); ++i)
+    {
+        if(segs_start.empty() || (long long)segs_end.back() <= (long long)r_start[i] + min_overlap)
+        {// new segment
+            segs_start.push_back( r_start[i] );
+            segs_end.push_back( r_end[i] );
         }
-        else
-        {
-            regional_alns.resize( i );
-            break;
+        else if(segs_end.back() < r_end[i])
+        {// update right-end
+            segs_end.back() = r_end[i];
         }
+        seg_ids.push_back( segs_start.size() - 1 );
     }
 }
 
 #ifdef FOR_NORA_EXAMINATION
 void Region::write_vertices(size_t r_id, std::ostream& out) const
 {
-    const int n = segs_start.size();
+    const size_t n = segs_start.size();
     out << r_id << ' ' << n << std::endl;
     for(size_t i = 0; i < n; ++i)
         out << segs_start[i] << ' ' << segs_end[i] << std::endl;
 }
 #endif
 
-void Region::make_pairs(InvertedRepeats* inv_repeats/* = NULL */)
+bool Region::make_pairs()
 {
-    std::map<size_t, std::vector<size_t> >::iterator it;
+    // group the alignments by read, the 5' ends before the 3' ends
+    std::vector<PairKey> keys( regional_alns.size() );
     for(size_t i = 0; i < regional_alns.size(); ++i)
     {
-        if(inv_repeats && inv_repeats->contained( regional_alns[i].r_start, regional_alns[i].r_end ))
-            continue;
-        if(regional_alns[i].is_5end())
-        {
-            it = pair_5.find( regional_alns[i].q_id );
-            if(it == pair_5.end())
-                pair_5[ regional_alns[i].q_id ] = std::vector<size_t>(1, i);
-            else
-                it->second.push_back( i );
-        }
-        else
-        {
-            it = pair_3.find( regional_alns[i].q_id );
-            if(it == pair_3.end())
-                pair_3[ regional_alns[i].q_id ] = std::vector<size_t>(1, i);
-            else
-                it->second.push_back( i );
-        }
+        keys[i].key = (uint64_t(regional_alns.q_id[i]) << 1) | (regional_alns.is_5end(i) ? 0 : 1);
+        keys[i].index = i;
+    }
+    std::sort( keys.begin(), keys.end() );
+    pair_alns.resize( keys.size() );
+    for(size_t i = 0; i < keys.size(); ++i)
+        pair_alns[i] = keys[i].index;
+
+    // the same test as gen_edges(), stopping at the first candidate edge
+    const std::vector<uint32_t>& q_id = regional_alns.q_id;
+    const size_t n = pair_alns.size();
+    size_t first = 0, mid, last;
+    for(; first < n; first = last)
+    {
+        mid = first;
+        while(mid < n && q_id[ pair_alns[mid] ] == q_id[ pair_alns[first] ] && regional_alns.is_5end( pair_alns[mid] ))
+            ++mid;
+        last = mid;
+        while(last < n && q_id[ pair_alns[last] ] == q_id[ pair_alns[first] ])
+            ++last;
+        for(size_t u = first; u < mid; ++u)
+            for(size_t v = mid; v < last; ++v)
+                if(seg_ids[ pair_alns[u] ] != seg_ids[ pair_alns[v] ] &&
+                        regional_alns.is_forward( pair_alns[u] ) != regional_alns.is_forward( pair_alns[v] ))
+                    return true;
     }
+    return false;
+}
+
+void Region::filter_pairs(const InvertedRepeats& inv_repeats)
+{
+    std::vector<bool> in_repeat;    // the alignments are sorted by r_start after gen_vertices()
+    inv_repeats.contained( regional_alns.r_start, regional_alns.r_end, in_repeat );
+    size_t n = 0;
+    for(size_t i = 0; i < pair_alns.size(); ++i)
+        if(! in_repeat[ pair_alns[i] ])
+            pair_alns[n++] = pair_alns[i];
+    pair_alns.resize(n);
 }
 
 #ifdef FOR_NORA_EXAMINATION
-void Region::write_graph(size_t r_id, std::ostream& out, std::ostream& out_graph_bridge)
+void Region::gen_edges(std::vector<VertexPair>& edges, size_t r_id, std::ostream& out_graph_bridge)
 #else
-void Region::write_graph(size_t r_id, std::ostream& out)
+void Region::gen_edges(std::vector<VertexPair>& edges)
 #endif
 {
-    std::set<VertexPair> edges;
-    std::set<VertexPair>::iterator eit;
-    VertexPair e;
-    std::map<size_t, std::vector<size_t> >::iterator it5, it3;
-    for(it5 = pair_5.begin(); it5 != pair_5.end(); ++it5)
+    EdgeCounter edge_counter;
+    const std::vector<uint32_t>& q_id = regional_alns.q_id;
+    const size_t n = pair_alns.size();
+    const uint32_t* alns = (n > 0 ? &pair_alns[0] : NULL);
+    size_t first = 0, mid, last;
+    for(; first < n; first = last)
     {
-        it3 = pair_3.find( it5->first );
-        if(it3 == pair_3.end()) continue;
-        for(std::vector<size_t>::iterator uit = it5->second.begin();
-                uit != it5->second.end(); ++uit)
+        // pair_alns[first, mid): 5' ends of a read; pair_alns[mid, last): its 3' ends
+        mid = first;
+        while(mid < n && q_id[ alns[mid] ] == q_id[ alns[first] ] && regional_alns.is_5end( alns[mid] ))
+            ++mid;
+        last = mid;
+        while(last < n && q_id[ alns[last] ] == q_id[ alns[first] ])
+            ++last;
+        for(const uint32_t* uit = alns + first; uit != alns + mid; ++uit)
         {
-            for(std::vector<size_t>::iterator vit = it3->second.begin();
-                    vit != it3->second.end(); ++vit)
+            for(const uint32_t* vit = alns + mid; vit != alns + last; ++vit)
             {
                 if(seg_ids[ *uit ] == seg_ids[ *vit ] || 
-                        regional_alns[ *uit ].is_forward() == regional_alns[ *vit ].is_forward())
+                        regional_alns.is_forward( *uit ) == regional_alns.is_forward( *vit ))
                 {
                     // if the validated region still have inversions inside, ignore it
                     // or the two reads are in the same direction, ignore it
                     continue;
                 }
-                e.set_uvw( seg_ids[ *uit ], seg_ids[ *vit ] );
-                eit = edges.find( e );
-                if(eit == edges.end())
-                    edges.insert( e );
-                else
-                    (*eit).inc_weight();
+                edge_counter.add( seg_ids[ *uit ], seg_ids[ *vit ] );
             #ifdef FOR_NORA_EXAMINATION
                 out_graph_bridge << r_id << ' ' << regional_alns[ *uit ]
                         << ' ' << seg_ids[*uit] << ' ' << segs_start[ seg_ids[*uit] ] << ' ' << segs_end[ seg_ids[*uit] ] << std::endl;
@@ -459,71 +839,104 @@ void Region::write_graph(size_t r_id, std::ostream& out)
         }
     }
 
-    if(not edges.empty())
+#ifdef DEBUG_EDGE_WEIGHT_FILTER
+    const size_t min_weight = 5;
+#else
+    const size_t min_weight = 0;
+#endif
+    edge_counter.get_edges( edges, min_weight );
+}
+
+#ifdef FOR_NORA_EXAMINATION
+void Region::write_graph(size_t r_id, std::ostream& out, std::ostream& out_graph_bridge)
+#else
+void Region::write_graph(size_t r_id, std::ostream& out)
+#endif
+{
+    std::vector<VertexPair> edges;
+#ifdef FOR_NORA_EXAMINATION
+    gen_edges(edges, r_id, out_graph_bridge);
+#else
+    gen_edges(edges);
+#endif
+    write_graph(r_id, edges, out);
+}
+
+/*static*/ void Region::write_graph(size_t r_id, const std::vector<VertexPair>& edges, std::ostream& out)
+{
+    if(edges.empty())   return;
+    out << edges.size() << ' ' << r_id << std::endl;
+    for(std::vector<VertexPair>::const_iterator eit = edges.begin(); eit != edges.end(); ++eit)
+        out << eit->u << ' ' << eit->v << ' ' << eit->w << std::endl;
+}
+
+/*static*/ void Region::read_graph_cut(size_t n_vertices, size_t n_edges,
+        std::istream& graph_in, std::istream& maxcut_in,
+        std::vector<int>& node_names, std::vector<bool>& max_cut,
+        std::vector<VertexPair>& edges)
+{
+    node_names.resize( n_vertices );
+    max_cut.resize( n_vertices );
+    bool u_party;
+    for(size_t i = 0; i < n_vertices; ++i)
     {
-    #ifdef DEBUG_EDGE_WEIGHT_FILTER
-        size_t edge_count = 0;
-        const int min_weight = 5;
-        for(eit = edges.begin(); eit != edges.end(); ++eit)
-            if((*eit).w > min_weight)
-                ++edge_count;
-        if(edge_count > 0)
-        {
-            out << edge_count << ' ' << r_id << std::endl;
-            for(eit = edges.begin(); eit != edges.end(); ++eit)
-                if((*eit).w > min_weight)
-                    out << (*eit).u << ' ' << (*eit).v << ' ' << (*eit).w << std::endl;
-        }
-    #else
-        out << edges.size() << ' ' << r_id << std::endl;
-        for(eit = edges.begin(); eit != edges.end(); ++eit)
-            out << (*eit).u << ' ' << (*eit).v << ' ' << (*eit).w << std::endl;
-    #endif
+        maxcut_in >> node_names[i] >> u_party;
+        max_cut[i] = u_party;
     }
+
+    edges.resize( n_edges );
+    for(size_t i = 0; i < n_edges; ++i)
+        graph_in >> edges[i].u >> edges[i].v >> edges[i].w;
 }
 
 void Region::report_inversions(size_t r_id, size_t n_vertices, size_t n_edges,
         std::istream& graph_in, std::istream& maxcut_in, std::ostream& inv_out)
 {
+    std::vector<int> node_names;
+    std::vector<bool> max_cut;
+    std::vector<VertexPair> edges;
+    read_graph_cut(n_vertices, n_edges, graph_in, maxcut_in, node_names, max_cut, edges);
+    report_inversions(r_id, node_names, max_cut, edges, inv_out);
+}
+
+void Region::report_inversions(size_t r_id, const std::vector<int>& node_names,
+        const std::vector<bool>& solution, const std::vector<VertexPair>& edges,
+        std::ostream& inv_out, std::ostream& debug_out/* = std::cout*/)
+{
+    size_t n_vertices = node_names.size();
     RelabelSmallPosInt<int, int> node_relabel;
     std::vector<bool> max_cut(n_vertices, false);
 
-    int u_name, v_name, e_weight;
-    bool u_party;
     for(size_t i = 0; i < n_vertices; ++i)
-    {
-        maxcut_in >> u_name >> u_party;
-        max_cut[ node_relabel.add_raw_id( u_name ) ] = u_party;
-    }
+        max_cut[ node_relabel.add_raw_id( node_names[i] ) ] = solution[i];
 
     std::vector< std::vector<int> > graph( n_vertices );
     int u_id, v_id;
 #ifdef DEBUG_B_GRAPH_PRINT
-    std::cout << "Print graph" << std::endl;
+    debug_out << "Print graph" << std::endl;
 #endif
-    for(size_t i = 0; i < n_edges; ++i)
+    for(std::vector<VertexPair>::const_iterator eit = edges.begin(); eit != edges.end(); ++eit)
     {
-        graph_in >> u_name >> v_name >> e_weight;
-        u_id = node_relabel.get_new_id( u_name );
-        v_id = node_relabel.get_new_id( v_name );
+        u_id = node_relabel.get_new_id( eit->u );
+        v_id = node_relabel.get_new_id( eit->v );
         if( max_cut[ u_id ] == max_cut[ v_id ])
             continue;
         graph[ u_id ].push_back( v_id );
         graph[ v_id ].push_back( u_id );
     #ifdef DEBUG_B_GRAPH_PRINT
-        std::cout << "(" << u_name << ',' << v_name <<"; " << e_weight << ")" << std::endl;
+        debug_out << "(" << int(eit->u) << ',' << int(eit->v) <<"; " << int(eit->w) << ")" << std::endl;
     #endif
     }
 #ifdef DEBUG_B_GRAPH_PRINT
-    std::cout << "Print graph finished" << std::endl;
+    debug_out << "Print graph finished" << std::endl;
 #endif
 
     std::vector<bool> visited( n_vertices, false );
     std::vector<int> flip_id;
-    int flip_left;
+    size_t flip_left;
     size_t weight_false = 0, weight_true = 0;
     size_t tmp_weight;
-    for(int i = 0; i < n_vertices; ++i)
+    for(size_t i = 0; i < n_vertices; ++i)
     {
         if(! visited[i])
         {
@@ -565,9 +978,9 @@ void Region::report_inversions(size_t r_id, size_t n_vertices, size_t n_edges,
     if(false_cnt == 0)  return;
     inv_out << false_cnt << ' ' << r_id << std::endl;
 #ifdef DEBUG_B_GRAPH_PRINT
-    std::cout << "solution: " << std::endl;
+    debug_out << "solution: " << std::endl;
 #endif
-    for(int i = 0; i < n_vertices; ++i)
+    for(size_t i = 0; i < n_vertices; ++i)
     {
         if(!max_cut[i])
         {
@@ -578,17 +991,17 @@ void Region::report_inversions(size_t r_id, size_t n_vertices, size_t n_edges,
         if(max_cut[i])
         {
             int raw_id = node_relabel.get_raw_id( i );
-            std::cout << "(1, " << raw_id << "): " << segs_start[ raw_id ] << ' ' << segs_end[ raw_id ] << "; weight=" << (segs_end[ raw_id] - segs_start[ raw_id ])<< std::endl;
+            debug_out << "(1, " << raw_id << "): " << segs_start[ raw_id ] << ' ' << segs_end[ raw_id ] << "; weight=" << (segs_end[ raw_id] - segs_start[ raw_id ])<< std::endl;
         }
         else
         {
             int raw_id = node_relabel.get_raw_id( i );
-            std::cout << "(0, " << raw_id << "): " << segs_start[ raw_id ] << ' ' << segs_end[ raw_id ] << "; weight=" << (segs_end[raw_id] - segs_start[raw_id]) << std::endl;
+            debug_out << "(0, " << raw_id << "): " << segs_start[ raw_id ] << ' ' << segs_end[ raw_id ] << "; weight=" << (segs_end[raw_id] - segs_start[raw_id]) << std::endl;
         }
     #endif
     }
 #ifdef DEBUG_B_GRAPH_PRINT
-    std::cout << "solution finished" << std::endl;
+    debug_out << "solution finished" << std::endl;
 #endif
 }
 
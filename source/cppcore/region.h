@@ -6,10 +6,9 @@
 #include <sstream>
 #include <string>
 #include <vector>
-#include <map>
-#include <set>
 #include <algorithm>
 #include <cstdio>
+#include <stdint.h>
 #include <RMQnlogn.hpp>
 
 namespace loon
@@ -18,21 +17,31 @@ namespace loon
 class InvertedRepeats
 {
 public:
-    std::vector<size_t> r_starts, r_ends;
+    std::vector<size_t> r_starts, r_ends;   // sorted by r_starts
+    std::vector<size_t> max_ends;           // max_ends[k] = max(r_ends[0..k])
     std::string prefix;
-    std::ifstream fin;
     
-    void parse_two_ints(const std::string& line);
+    void parse_two_ints(const char* p, const char* end);
+    void parse_delta(const char* p, const char* end);
     void quicksort(long long L, long long R);
     std::string compose_subdirectory(size_t n);
+    std::string delta_file(size_t file_id);
+    void build_index();
+    bool contained_from(size_t k, size_t i, size_t j) const;
 public:
-    InvertedRepeats(const std::string& filedir);
-    void open(size_t file_id);
-    void close();
-    void read();
+    InvertedRepeats(const std::string& filedir = "");
+    void load(size_t file_id); // read the repeats of the file_id-th reference
+    // copy n repeats that are already sorted by (start, end)
+    void assign(const uint64_t* starts, const uint64_t* ends, size_t n);
+    // load the repeats of references [0, n_refs) with n_threads threads
+    static void load_all(const std::string& filedir, size_t n_refs,
+            int n_threads, std::vector<InvertedRepeats>& repeats);
     void clear();
     size_t size() const;
     bool contained(size_t i, size_t j) const;
+    // result[q] = contained(starts[q], ends[q]); fastest if `starts` is sorted
+    void contained(const std::vector<uint32_t>& starts,
+            const std::vector<uint32_t>& ends, std::vector<bool>& result) const;
 };
 
 class VertexPair
@@ -44,7 +53,6 @@ public:
     VertexPair(size_t u, size_t v, size_t weight = 1);
     bool operator<(const VertexPair& rhs) const;
     void set_uvw(size_t u, size_t v, size_t w = 1);
-    void inc_weight() const;
 };
 
 class OneAln
@@ -66,25 +74,57 @@ public:
             long long rstart, long long rend,
             long long qstart, long long qend,
             short mapQ, char dir);
+    OneAln(size_t qid, char qpos, long long qrawlen, long long qlen,
+            long long rstart, long long rend,
+            long long qstart, long long qend,
+            short mapQ, char dir);
+    static void parse_qname(const char* qname, size_t qname_len,
+            size_t& qid, char& qpos, long long& qrawlen);
     bool is_forward() const;
     bool is_backward() const;
     bool is_5end() const;
-    void invalidate();
     bool is_valid() const;
-    bool operator<(const OneAln& rhs) const;
 #ifdef FOR_NORA_EXAMINATION
     friend std::ostream& operator<<(std::ostream& out, const OneAln& obj);
 #endif
 };
 
+// Alignments of one reference stored column by column, so that a sweep only
+// touches the columns it needs. Read ids and positions are kept in 32 bits.
+class AlnStore
+{
+public:
+    std::vector<uint32_t> q_id;
+    std::vector<uint32_t> q_length;     // 0 if the alignment is invalid
+    std::vector<uint32_t> r_start, r_end;
+    std::vector<uint32_t> q_start, q_end;
+    std::vector<short> mapping_quality;
+    std::vector<char> direction, q_pos;
+#ifdef FOR_NORA_EXAMINATION
+    std::vector<uint32_t> q_raw_len;
+#endif
+public:
+    size_t size() const;
+    void reserve(size_t n);
+    void clear();
+    void push_back(const OneAln& aln);
+    OneAln operator[](size_t i) const;
+    bool is_forward(size_t i) const;
+    bool is_5end(size_t i) const;
+    void invalidate(size_t i);
+    bool is_valid(size_t i) const;
+    // keep only the alignments order[0], order[1], ..., in this order
+    void permute(const std::vector<uint32_t>& order);
+};
+
 class SegEndpoint
 {
 public:
-    size_t seg_id; // index of the alignment region in the reference genome
-    size_t loc;
+    uint32_t seg_id; // index of the alignment region in the reference genome
+    uint32_t loc;
     bool is_start;
 public:
-    SegEndpoint(size_t s_id = -1, size_t l=-1, bool is_left=false):
+    SegEndpoint(uint32_t s_id = -1, uint32_t l = -1, bool is_left=false):
         seg_id(s_id), loc(l), is_start(is_left)
     {}
     bool operator<(const SegEndpoint& se) const
@@ -101,30 +141,56 @@ class Region
 private:
     long long r_length;
     std::string r_name;
-    std::vector< OneAln > regional_alns;
-    std::vector< size_t > segs_start;   // start_loc of validated segment
-    std::vector< size_t > segs_end;     // end_loc of validated segments
-    std::vector< size_t > seg_ids;      // validated segment ID of the current alignment in the reference genome
-    std::map<size_t, std::vector<size_t> > pair_5, pair_3;
+    AlnStore regional_alns;
+    std::vector< uint32_t > segs_start; // start_loc of validated segment
+    std::vector< uint32_t > segs_end;   // end_loc of validated segments
+    std::vector< uint32_t > seg_ids;    // validated segment ID of the current alignment in the reference genome
+    std::vector< uint32_t > pair_alns;  // alignments grouped by read, the 5' ends before the 3' ends
 public:
     void add_ref_info(long long len, const std::string& name);
+    long long get_length() const;
+    const std::string& get_name() const;
+    size_t size() const;
+    OneAln operator[](size_t i) const;
+    void reserve(size_t n);
     void push_back(const std::string& q_name, long long q_length, 
             long long r_start, long long r_end,
             long long q_start, long long q_end, 
             short mapping_quality, char direction);
+    void push_back(const char* q_name, size_t q_name_len, long long q_length,
+            long long r_start, long long r_end,
+            long long q_start, long long q_end,
+            short mapping_quality, char direction);
+    void push_back(size_t q_id, char q_pos, long long q_raw_len, long long q_length,
+            long long r_start, long long r_end,
+            long long q_start, long long q_end,
+            short mapping_quality, char direction);
     void clear();
     void clear_name();
     void remove_low_coverage_reads(int min_cvg = 0, double min_cvg_percent = 0.0);
     void gen_vertices(int min_overlap = 0);
-    void make_pairs(InvertedRepeats* inv_repeats = NULL);
+    // false if no read joins two segments in opposite directions, so that
+    // gen_edges() gives no edge whatever filter_pairs() removes
+    bool make_pairs();
+    void filter_pairs(const InvertedRepeats& inv_repeats); // drop the alignments in inverted repeats
 #ifdef FOR_NORA_EXAMINATION
     void write_vertices(size_t r_id, std::ostream& out) const;
+    void gen_edges(std::vector<VertexPair>& edges, size_t r_id, std::ostream& out_graph_bridge);
     void write_graph(size_t r_id, std::ostream& out, std::ostream& out_graph_bridge);
 #else
+    void gen_edges(std::vector<VertexPair>& edges);
     void write_graph(size_t r_id, std::ostream& out);
 #endif
+    static void write_graph(size_t r_id, const std::vector<VertexPair>& edges, std::ostream& out);
+    static void read_graph_cut(size_t n_vertices, size_t n_edges,
+            std::istream& graph_in, std::istream& maxcut_in,
+            std::vector<int>& node_names, std::vector<bool>& max_cut,
+            std::vector<VertexPair>& edges);
     void report_inversions(size_t r_id, size_t n_vertices, size_t n_edges,
             std::istream& graph_in, std::istream& maxcut_in, std::ostream& inv_out);
+    void report_inversions(size_t r_id, const std::vector<int>& node_names,
+            const std::vector<bool>& max_cut, const std::vector<VertexPair>& edges,
+            std::ostream& inv_out, std::ostream& debug_out = std::cout);
 };
 
 }//namespace loon
@@ -0,0 +1,393 @@
+#include <stdexcept>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <utility>
+#include <parallel.h>
+#include "repeat_finder.h"
+#include "repeat_index.h"
+
+namespace loon
+{
+
+namespace
+{
+
+// windows handled by each task when a reference is sketched by several threads
+const size_t WINDOWS_PER_TASK = 1 << 20;
+
+// 2-bit code of a base, 4 for anything else
+inline int base_code(char ch)
+{
+    switch(ch)
+    {
+        case 'A': case 'a': return 0;
+        case 'C': case 'c': return 1;
+        case 'G': case 'g': return 2;
+        case 'T': case 't': return 3;
+        default:            return 4;
+    }
+}
+
+// invertible integer hash on the lowest bits of `mask`, so that two
+// different k-mers never share a hash
+inline uint64_t hash64(uint64_t key, uint64_t mask)
+{
+    key = (~key + (key << 21)) & mask;
+    key = key ^ key >> 24;
+    key = ((key + (key << 3)) + (key << 8)) & mask;
+    key = key ^ key >> 14;
+    key = ((key + (key << 2)) + (key << 4)) & mask;
+    key = key ^ key >> 28;
+    key = (key + (key << 31)) & mask;
+    return key;
+}
+
+// a chain of anchors along an anti-diagonal
+struct Chain
+{
+    uint32_t first_p, last_p, last_q;
+    uint64_t covered;   // bases of the reference covered by the anchors
+};
+
+}// anonymous namespace
+
+bool RepeatFinder::Minimizer::operator<(const Minimizer& rhs) const
+{
+    return key < rhs.key || (key == rhs.key && pos < rhs.pos);
+}
+
+bool RepeatFinder::Anchor::operator<(const Anchor& rhs) const
+{
+    return p < rhs.p || (p == rhs.p && q < rhs.q);
+}
+
+RepeatFinder::RepeatFinder(int k/* = 20*/, int w/* = 10*/, int min_cluster/* = 65*/,
+        int max_gap/* = 90*/, int diag_diff/* = 5*/, int max_occ/* = 500*/):
+    k(k), w(w), min_cluster(min_cluster), max_gap(max_gap), diag_diff(diag_diff), max_occ(max_occ)
+{
+    if(k < 1 || k > 31)
+        throw std::runtime_error("repeat_finder: k must be in [1, 31]");
+    if(w < 1)
+        throw std::runtime_error("repeat_finder: w must be positive");
+}
+
+void RepeatFinder::add_reference(const std::string& seq)
+{
+    if(fasta.data())
+        throw std::runtime_error("repeat_finder: cannot add a reference to the ones of a FASTA file");
+    if(seq.size() > 0xFFFFFFFFu)
+        throw std::runtime_error("repeat_finder: reference is too long");
+    sequences.push_back(seq);
+    lengths.push_back(seq.size());
+}
+
+void RepeatFinder::open_fasta(const std::string& fname)
+{
+    clear();
+    if(! fasta.open(fname))
+        throw std::runtime_error("repeat_finder: cannot open file [" + fname + "]");
+    const char* data = fasta.data();
+    const size_t n = fasta.size();
+    if(n >= 2 && (unsigned char)data[0] == 0x1f && (unsigned char)data[1] == 0x8b)
+    {
+        clear();
+        throw std::runtime_error("repeat_finder: file [" + fname + "] is compressed");
+    }
+
+    for(size_t pos = 0; pos < n; )
+    {
+        const char* eol = static_cast<const char*>( std::memchr(data + pos, '\n', n - pos) );
+        size_t next = (eol ? eol - data + 1 : n);
+        if(data[pos] == '>')
+        {
+            fasta_begin.push_back(next);
+            fasta_end.push_back(next);
+            lengths.push_back(0);
+        }
+        else if(! lengths.empty())
+        {
+            for(size_t j = pos; j < next; ++j)
+                if(! std::isspace((unsigned char)data[j]))
+                    ++lengths.back();
+            fasta_end.back() = next;
+        }
+        else if(! std::isspace((unsigned char)data[pos]))
+        {
+            clear();
+            throw std::runtime_error("repeat_finder: file [" + fname + "] is not a FASTA file");
+        }
+        pos = next;
+    }
+    for(size_t i = 0; i < lengths.size(); ++i)
+    {
+        if(lengths[i] > 0xFFFFFFFFu)
+        {
+            clear();
+            throw std::runtime_error("repeat_finder: reference is too long");
+        }
+    }
+}
+
+size_t RepeatFinder::size() const
+{
+    return lengths.size();
+}
+
+void RepeatFinder::clear()
+{
+    sequences.clear();
+    fasta.close();
+    fasta_begin.clear();
+    fasta_end.clear();
+    lengths.clear();
+}
+
+const std::string& RepeatFinder::sequence(size_t i, std::string& buf) const
+{
+    if(! fasta.data())  return sequences[i];
+    buf.clear();
+    buf.reserve(lengths[i]);
+    const char* data = fasta.data();
+    for(size_t j = fasta_begin[i]; j < fasta_end[i]; ++j)
+        if(! std::isspace((unsigned char)data[j]))
+            buf.push_back(data[j]);
+    return buf;
+}
+
+void RepeatFinder::sketch(const std::string& seq, size_t first, size_t last,
+        std::vector<Minimizer>& minimizers) const
+{
+    const size_t n_kmers = seq.size() + 1 - k;  // the caller ensures seq.size() >= k
+    const size_t kmer_end = std::min(last + w - 1, n_kmers);
+    const uint64_t mask = (uint64_t(1) << (2 * k)) - 1;
+    const int shift = 2 * (k - 1);
+
+    uint64_t fwd = 0, rev = 0;
+    int valid = 0;      // number of ACGT bases ending at j
+    std::deque<Minimizer> window;   // increasing keys; the front is the minimizer
+    minimizers.clear();
+    for(size_t j = first; j < kmer_end + k - 1; ++j)
+    {
+        int c = base_code(seq[j]);
+        if(c > 3)
+        {
+            valid = 0;
+        }
+        else
+        {
+            fwd = ((fwd << 2) | c) & mask;
+            rev = (rev >> 2) | (uint64_t(3 - c) << shift);
+            ++valid;
+        }
+        if(j + 1 < first + k)   continue;
+
+        size_t i = j + 1 - k;   // the k-mer seq[i, i+k)
+        if(valid >= k && fwd != rev)   // a palindromic k-mer has no strand
+        {
+            Minimizer m;
+            m.key = (hash64(std::min(fwd, rev), mask) << 1) | (rev < fwd ? 1 : 0);
+            m.pos = i;
+            while(! window.empty() && (window.back().key >> 1) > (m.key >> 1))
+                window.pop_back();
+            window.push_back(m);
+        }
+        if(i + 1 < first + w && i + 1 < n_kmers)  continue;   // the first window is not full yet
+
+        size_t s = (i + 1 >= size_t(w) ? i + 1 - w : 0);   // the window [s, s+w) ends at i
+        while(! window.empty() && window.front().pos < s)
+            window.pop_front();
+        if(! window.empty() && (minimizers.empty() || minimizers.back().pos != window.front().pos))
+            minimizers.push_back( window.front() );
+    }
+}
+
+void RepeatFinder::collect_anchors(const std::string& seq, int n_threads, std::vector<Anchor>& anchors) const
+{
+    anchors.clear();
+    if(seq.size() < size_t(k))  return;
+    const size_t n_kmers = seq.size() + 1 - k;
+    const size_t n_windows = (n_kmers > size_t(w) ? n_kmers - w + 1 : 1);
+
+    // the minimizers of consecutive windows may be the same k-mer, also across tasks
+    const size_t n_tasks = (n_windows + WINDOWS_PER_TASK - 1) / WINDOWS_PER_TASK;
+    std::vector< std::vector<Minimizer> > parts(n_tasks);
+    parallel_for(n_tasks, n_threads, [&](size_t t)
+    {
+        sketch(seq, t * WINDOWS_PER_TASK, std::min((t + 1) * WINDOWS_PER_TASK, n_windows), parts[t]);
+    });
+    std::vector<Minimizer> minimizers;
+    for(size_t t = 0; t < n_tasks; ++t)
+    {
+        for(size_t x = 0; x < parts[t].size(); ++x)
+            if(minimizers.empty() || minimizers.back().pos != parts[t][x].pos)
+                minimizers.push_back( parts[t][x] );
+        std::vector<Minimizer>().swap( parts[t] );
+    }
+    std::sort(minimizers.begin(), minimizers.end());
+
+    // the forward occurrences of a hash come before its reverse ones
+    for(size_t x = 0; x < minimizers.size(); )
+    {
+        size_t y = x, mid;
+        while(y < minimizers.size() && (minimizers[y].key >> 1) == (minimizers[x].key >> 1))
+            ++y;
+        for(mid = x; mid < y && (minimizers[mid].key & 1) == 0; ++mid)
+            ;
+        if(y - x <= size_t(max_occ))
+        {
+            for(size_t a = x; a < mid; ++a)
+            {
+                for(size_t b = mid; b < y; ++b)
+                {
+                    Anchor anchor;
+                    anchor.p = minimizers[a].pos;   anchor.q = minimizers[b].pos;
+                    anchors.push_back(anchor);
+                    std::swap(anchor.p, anchor.q);
+                    anchors.push_back(anchor);
+                }
+            }
+        }
+        x = y;
+    }
+    std::sort(anchors.begin(), anchors.end());
+}
+
+void RepeatFinder::chain(const std::vector<Anchor>& anchors, InvertedRepeats& repeats) const
+{
+    const uint64_t reach = uint64_t(max_gap) + k;  // max distance between two anchors of a chain
+    std::vector<Chain> chains;
+    std::multimap<int64_t, size_t> active;  // anti-diagonal of the last anchor -> chain
+    std::vector< std::pair<size_t, size_t> > found;
+    uint64_t swept = 0;
+
+    auto finish = [&](size_t c)
+    {
+        if(chains[c].covered >= uint64_t(min_cluster))
+            found.push_back( std::make_pair(chains[c].first_p, chains[c].last_p + k) );
+    };
+
+    for(size_t x = 0; x < anchors.size(); ++x)
+    {
+        const uint32_t p = anchors[x].p, q = anchors[x].q;
+        const int64_t d = int64_t(p) + q;
+
+        if(p > swept + reach)   // drop the chains that can no longer grow
+        {
+            for(std::multimap<int64_t, size_t>::iterator it = active.begin(); it != active.end(); )
+            {
+                if(p > chains[it->second].last_p + reach)
+                {
+                    finish(it->second);
+                    active.erase(it++);
+                }
+                else
+                    ++it;
+            }
+            swept = p;
+        }
+
+        std::multimap<int64_t, size_t>::iterator best = active.end();
+        int64_t best_diff = 0;
+        std::multimap<int64_t, size_t>::iterator it = active.lower_bound(d - diag_diff);
+        while(it != active.end() && it->first <= d + diag_diff)
+        {
+            const Chain& c = chains[it->second];
+            if(p > c.last_p + reach)
+            {
+                finish(it->second);
+                active.erase(it++);
+                continue;
+            }
+            int64_t diff = (it->first > d ? it->first - d : d - it->first);
+            if(c.last_p < p && q < c.last_q && (best == active.end() || diff < best_diff))
+            {
+                best = it;
+                best_diff = diff;
+            }
+            ++it;
+        }
+
+        if(best == active.end())
+        {
+            Chain c;
+            c.first_p = c.last_p = p;
+            c.last_q = q;
+            c.covered = k;
+            chains.push_back(c);
+            active.insert( std::make_pair(d, chains.size() - 1) );
+        }
+        else
+        {
+            size_t id = best->second;
+            Chain& c = chains[id];
+            c.covered += std::min<uint64_t>(k, p - c.last_p);
+            c.last_p = p;
+            c.last_q = q;
+            active.erase(best);
+            active.insert( std::make_pair(d, id) );
+        }
+    }
+    for(std::multimap<int64_t, size_t>::iterator it = active.begin(); it != active.end(); ++it)
+        finish(it->second);
+
+    std::sort(found.begin(), found.end());
+    found.erase( std::unique(found.begin(), found.end()), found.end() );
+    repeats.clear();
+    repeats.r_starts.resize( found.size() );
+    repeats.r_ends.resize( found.size() );
+    for(size_t x = 0; x < found.size(); ++x)
+    {
+        repeats.r_starts[x] = found[x].first;
+        repeats.r_ends[x] = found[x].second;
+    }
+    repeats.build_index();
+}
+
+void RepeatFinder::find(size_t i, InvertedRepeats& repeats, int n_threads/* = 1*/) const
+{
+    std::vector<Anchor> anchors;
+    {
+        std::string buf;
+        collect_anchors(sequence(i, buf), n_threads, anchors);
+    }
+    chain(anchors, repeats);
+}
+
+void RepeatFinder::find_all(std::vector<InvertedRepeats>& repeats, int n_threads/* = 1*/) const
+{
+    repeats.assign(size(), InvertedRepeats());
+    std::vector<size_t> order(size());
+    size_t total = 0;
+    for(size_t i = 0; i < size(); ++i)
+    {
+        order[i] = i;
+        total += lengths[i];
+    }
+    std::stable_sort(order.begin(), order.end(),
+            [this](size_t a, size_t b) { return lengths[a] > lengths[b]; });
+
+    // a reference holding at least a thread's share of the genome uses all the
+    // threads by itself; the others get one thread each
+    size_t n_big = 0;
+    while(n_threads > 1 && n_big < order.size() && lengths[ order[n_big] ] * n_threads >= total)
+    {
+        find(order[n_big], repeats[ order[n_big] ], n_threads);
+        ++n_big;
+    }
+    parallel_for(order.size() - n_big, n_threads, [&](size_t x)
+    {
+        find(order[n_big + x], repeats[ order[n_big + x] ]);
+    });
+}
+
+void RepeatFinder::write_index(const std::string& fname, int n_threads/* = 1*/) const
+{
+    std::vector<InvertedRepeats> repeats;
+    find_all(repeats, n_threads);
+    RepeatIndexFile::write(fname, repeats);
+}
+
+}// namespace loon
@@ -0,0 +1,79 @@
+#ifndef __INVDET_REPEAT_FINDER_H
+#define __INVDET_REPEAT_FINDER_H
+
+/*
+Inverted repeats of a reference found without nucmer
+
+A k-mer at p and a k-mer at q form a seed if one is the reverse complement
+of the other. Seeds are sampled with (w, k)-minimizers of the canonical
+k-mers, so they are the minimizers that occur on both strands. Along an
+inverted repeat, p grows while q shrinks by the same amount: the seeds
+are chained along the anti-diagonal p + q, allowing a shift of at most
+`diag_diff` and a gap of at most `max_gap` between two seeds, as the
+clusters of nucmer. A chain covering at least `min_cluster` bases of the
+reference is reported as the inverted repeat [p_first, p_last + k), the
+same interval nucmer --maxmatch --reverse gives in its delta file.
+*/
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <mapped_file.h>
+#include "region.h"
+
+namespace loon
+{
+
+class RepeatFinder
+{
+private:
+    struct Minimizer
+    {
+        uint64_t key;   // hash of the canonical k-mer << 1 | (1 if it is the reverse strand)
+        uint32_t pos;
+        bool operator<(const Minimizer& rhs) const;
+    };
+    struct Anchor
+    {
+        uint32_t p, q;  // seq[p, p+k) is the reverse complement of seq[q, q+k)
+        bool operator<(const Anchor& rhs) const;
+    };
+
+    // the references come from add_reference() or from a FASTA file, of which
+    // only the one being searched is copied out
+    std::vector<std::string> sequences;
+    MappedFile fasta;
+    std::vector<size_t> fasta_begin, fasta_end;  // the sequence lines of each reference in `fasta`
+    std::vector<size_t> lengths;    // number of bases of each reference
+    int k, w, min_cluster, max_gap, diag_diff, max_occ;
+
+    RepeatFinder(const RepeatFinder&);
+    RepeatFinder& operator=(const RepeatFinder&);
+
+    // the i-th reference, in `buf` if it has to be read from the FASTA file
+    const std::string& sequence(size_t i, std::string& buf) const;
+
+    // minimizers of the windows starting at [first, last)
+    void sketch(const std::string& seq, size_t first, size_t last,
+            std::vector<Minimizer>& minimizers) const;
+    void collect_anchors(const std::string& seq, int n_threads, std::vector<Anchor>& anchors) const;
+    void chain(const std::vector<Anchor>& anchors, InvertedRepeats& repeats) const;
+public:
+    // max_occ: minimizers occurring more often are skipped as low-complexity
+    RepeatFinder(int k = 20, int w = 10, int min_cluster = 65,
+            int max_gap = 90, int diag_diff = 5, int max_occ = 500);
+    void add_reference(const std::string& seq);
+    // use the references of an uncompressed FASTA file in place of add_reference()
+    void open_fasta(const std::string& fname);
+    size_t size() const;
+    void clear();
+    // the inverted repeats of the i-th reference
+    void find(size_t i, InvertedRepeats& repeats, int n_threads = 1) const;
+    void find_all(std::vector<InvertedRepeats>& repeats, int n_threads = 1) const;
+    // find_all() and write the result as a RepeatIndexFile
+    void write_index(const std::string& fname, int n_threads = 1) const;
+};
+
+}// namespace loon
+
+#endif
@@ -0,0 +1,198 @@
+#include <fstream>
+#include <stdexcept>
+#include <cstring>
+#include "repeat_index.h"
+#include "repeat_finder.h"
+
+namespace loon
+{
+
+/*static*/ const char RepeatIndexFile::magic[8] = {'I', 'N', 'V', 'D', 'I', 'R', '0', '1'};
+
+RepeatIndexFile::RepeatIndexFile():
+    offsets(NULL), r_starts(NULL), r_ends(NULL), n_refs(0)
+{}
+
+/*static*/ bool RepeatIndexFile::is_index(const std::string& fname)
+{
+    std::ifstream fin(fname.c_str(), std::ios::binary);
+    char buf[sizeof(magic)];
+    if(! fin.is_open() || ! fin.read(buf, sizeof(magic)))   return false;
+    return std::memcmp(buf, magic, sizeof(magic)) == 0;
+}
+
+/*static*/ void RepeatIndexFile::write(const std::string& fname, const std::vector<InvertedRepeats>& repeats)
+{
+    std::ofstream fout(fname.c_str(), std::ios::binary);
+    if(! fout.is_open())    throw std::runtime_error("repeat_index: cannot open file [" + fname + "]");
+
+    uint64_t n = repeats.size();
+    std::vector<uint64_t> offsets(n + 1, 0);
+    for(size_t i = 0; i < n; ++i)
+        offsets[i + 1] = offsets[i] + repeats[i].size();
+
+    fout.write(magic, sizeof(magic));
+    fout.write(reinterpret_cast<const char*>(&n), sizeof(n));
+    fout.write(reinterpret_cast<const char*>(&offsets[0]), offsets.size() * sizeof(uint64_t));
+    std::vector<uint64_t> column;
+    for(int c = 0; c < 2; ++c)
+    {
+        for(size_t i = 0; i < n; ++i)
+        {
+            const std::vector<size_t>& src = (c == 0 ? repeats[i].r_starts : repeats[i].r_ends);
+            column.assign(src.begin(), src.end());
+            if(! column.empty())
+                fout.write(reinterpret_cast<const char*>(&column[0]), column.size() * sizeof(uint64_t));
+        }
+    }
+
+    if(! fout)  throw std::runtime_error("repeat_index: failed to write file [" + fname + "]");
+    fout.close();
+}
+
+/*static*/ void RepeatIndexFile::build(const std::string& fname, const std::string& nucmer_prefix,
+        size_t n_refs, int n_threads/* = 1*/)
+{
+    std::vector<InvertedRepeats> repeats;
+    InvertedRepeats::load_all(nucmer_prefix, n_refs, n_threads, repeats);
+    write(fname, repeats);
+}
+
+void RepeatIndexFile::open(const std::string& fname)
+{
+    close();
+    if(! file.open(fname))
+        throw std::runtime_error("repeat_index: cannot open file [" + fname + "]");
+    const char* data = file.data();
+    size_t data_size = file.size();
+    if(data_size < sizeof(magic) + 2 * sizeof(uint64_t) || std::memcmp(data, magic, sizeof(magic)) != 0)
+    {
+        close();
+        throw std::runtime_error("repeat_index: file [" + fname + "] is not an inverted repeat index");
+    }
+
+    uint64_t n = *reinterpret_cast<const uint64_t*>(data + sizeof(magic));
+    size_t n_words = (data_size - sizeof(magic)) / sizeof(uint64_t) - 1;
+    if(n >= n_words)
+    {
+        close();
+        throw std::runtime_error("repeat_index: file [" + fname + "] is truncated");
+    }
+    offsets = reinterpret_cast<const uint64_t*>(data + sizeof(magic) + sizeof(uint64_t));
+    uint64_t n_repeats = offsets[n];
+    if(offsets[0] != 0 || n_repeats > (n_words - n - 1) / 2)
+    {
+        close();
+        throw std::runtime_error("repeat_index: file [" + fname + "] is truncated");
+    }
+    for(size_t i = 0; i < n; ++i)
+    {
+        if(offsets[i] > offsets[i + 1])
+        {
+            close();
+            throw std::runtime_error("repeat_index: file [" + fname + "] is corrupted");
+        }
+    }
+    n_refs = n;
+    r_starts = offsets + n + 1;
+    r_ends = r_starts + n_repeats;
+}
+
+void RepeatIndexFile::close()
+{
+    file.close();
+    offsets = r_starts = r_ends = NULL;
+    n_refs = 0;
+}
+
+size_t RepeatIndexFile::size() const
+{
+    return n_refs;
+}
+
+void RepeatIndexFile::load(size_t ref_id, InvertedRepeats& repeats) const
+{
+    if(ref_id >= n_refs)
+        throw std::runtime_error("repeat_index: no inverted repeats for the reference");
+    repeats.assign( r_starts + offsets[ref_id], r_ends + offsets[ref_id],
+            offsets[ref_id + 1] - offsets[ref_id] );
+}
+
+RepeatCache::RepeatCache():
+    finder(NULL), has_index(false)
+{}
+
+void RepeatCache::open(const std::string& nucmer_prefix, size_t n_refs)
+{
+    if(finder == NULL && ! prefix.empty() && prefix == nucmer_prefix && repeats.size() == n_refs)
+        return;
+    close();
+    prefix = nucmer_prefix;
+    has_index = RepeatIndexFile::is_index(prefix);
+    if(has_index)
+    {
+        index.open(prefix);
+        if(index.size() < n_refs)
+        {
+            close();
+            throw std::runtime_error("repeat_index: too few references in file [" + nucmer_prefix + "]");
+        }
+    }
+    repeats.assign(n_refs, InvertedRepeats(prefix));
+    ready.assign(n_refs, 0);
+}
+
+void RepeatCache::open(const RepeatFinder& repeat_finder, size_t n_refs)
+{
+    if(finder == &repeat_finder && repeats.size() == n_refs)
+        return;
+    if(repeat_finder.size() < n_refs)
+        throw std::runtime_error("repeat_index: the repeat finder has too few references");
+    close();
+    finder = &repeat_finder;
+    repeats.assign(n_refs, InvertedRepeats());
+    ready.assign(n_refs, 0);
+}
+
+void RepeatCache::close()
+{
+    prefix.clear();
+    finder = NULL;
+    index.close();
+    has_index = false;
+    repeats.clear();
+    ready.clear();
+}
+
+bool RepeatCache::is_open() const
+{
+    return finder != NULL || ! prefix.empty();
+}
+
+const InvertedRepeats& RepeatCache::get(size_t ref_id, int n_threads/* = 1*/)
+{
+    if(ref_id >= repeats.size())
+        throw std::runtime_error("repeat_index: no inverted repeats for the reference");
+    std::lock_guard<std::mutex> lock( locks[ref_id % N_LOCKS] );
+    if(! ready[ref_id])
+    {
+        if(finder)
+            finder->find(ref_id, repeats[ref_id], n_threads);
+        else if(has_index)
+            index.load(ref_id, repeats[ref_id]);
+        else
+            repeats[ref_id].load(ref_id);
+        ready[ref_id] = 1;
+    }
+    return repeats[ref_id];
+}
+
+void RepeatCache::release(size_t ref_id)
+{
+    if(ref_id >= repeats.size())    return;
+    std::lock_guard<std::mutex> lock( locks[ref_id % N_LOCKS] );
+    repeats[ref_id] = InvertedRepeats(prefix);
+    ready[ref_id] = 0;
+}
+
+}// namespace loon
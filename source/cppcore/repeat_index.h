@@ -0,0 +1,91 @@
+#ifndef __INVDET_REPEAT_INDEX_H
+#define __INVDET_REPEAT_INDEX_H
+
+/*
+Binary index of the inverted repeats of all references (little-endian)
+
+    header      char magic[8] = "INVDIR01"
+                uint64 n_refs
+    offsets     uint64 offsets[n_refs + 1]
+                    the repeats of reference i are [offsets[i], offsets[i+1])
+    repeats     uint64 r_starts[offsets[n_refs]]
+                uint64 r_ends[offsets[n_refs]]
+                    sorted by (r_start, r_end) within each reference
+
+It is built once from the nucmer delta files (nc_aln.<i>.delta), so that
+the report stage does not parse them again.
+*/
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <stdint.h>
+#include <mapped_file.h>
+#include "region.h"
+
+namespace loon
+{
+
+class RepeatIndexFile
+{
+private:
+    MappedFile file;
+    const uint64_t* offsets;
+    const uint64_t* r_starts;
+    const uint64_t* r_ends;
+    size_t n_refs;
+public:
+    static const char magic[8];
+
+    RepeatIndexFile();
+    static bool is_index(const std::string& fname); // false if it cannot be read
+    static void write(const std::string& fname, const std::vector<InvertedRepeats>& repeats);
+    // parse the delta files of references [0, n_refs) under `nucmer_prefix`
+    // with `n_threads` threads and write their index to `fname`
+    static void build(const std::string& fname, const std::string& nucmer_prefix,
+            size_t n_refs, int n_threads = 1);
+    void open(const std::string& fname);
+    void close();
+    size_t size() const;
+    void load(size_t ref_id, InvertedRepeats& repeats) const;
+};
+
+class RepeatFinder;
+
+// The inverted repeats of the references, read or computed the first time a
+// reference asks for them and kept for the later calls until release(). They
+// come from an index of RepeatIndexFile, from the directory of the nucmer
+// delta files or from a RepeatFinder holding the references. get() and
+// release() may be called by several threads at once.
+class RepeatCache
+{
+private:
+    static const size_t N_LOCKS = 64;   // reference i is guarded by locks[i % N_LOCKS]
+
+    std::string prefix;
+    const RepeatFinder* finder;
+    RepeatIndexFile index;
+    bool has_index;
+    std::vector<InvertedRepeats> repeats;
+    std::vector<char> ready;
+    std::mutex locks[N_LOCKS];
+
+    RepeatCache(const RepeatCache&);
+    RepeatCache& operator=(const RepeatCache&);
+public:
+    RepeatCache();
+    // keep what is cached if the source and n_refs are the same as before
+    void open(const std::string& nucmer_prefix, size_t n_refs);
+    void open(const RepeatFinder& finder, size_t n_refs);
+    void close();
+    bool is_open() const;
+    // n_threads: threads of the search, if a RepeatFinder looks the repeats up
+    const InvertedRepeats& get(size_t ref_id, int n_threads = 1);
+    // free the repeats of a reference that is done with them; a later get()
+    // reads or computes them again
+    void release(size_t ref_id);
+};
+
+}// namespace loon
+
+#endif
@@ -3,8 +3,15 @@
 import sys
 import argparse
 import os
+import re
+import struct
+import array
 import pysam
 
+# see source/cppcore/brief_aln.h for the layout of the binary brief_alignment file
+BINARY_MAGIC = "INVDBAL1"
+AFUN_NAME = re.compile(r"(\d+).(.)(?:.(\d+))?")
+
 ### def print_aln(aln):
 ###     print "the alignment range is 0-based, and [ , )"
 ###     print
@@ -31,7 +38,72 @@ import pysam
 ###     print ">>> reference alignment pos"
 ###     print "[{}, {}): {}".format(aln.reference_start, aln.reference_end, aln.reference_length)
 
+def modify_query_name(qname):
+    qname = qname.split("/", 1)[0]
+    qname_tokens = qname.split("_")
+    qid = qname_tokens[0][qname_tokens[0].find("afun") + len("afun"):]
+    return "{}/{}/0_{}".format(qname, qid, int(qname_tokens[2])-1)
+
+def parse_query_name(qname):
+    """Parse `afun<q_id>_<q_pos>_<q_raw_len>...` into (q_id, q_pos, q_raw_len)"""
+    m = AFUN_NAME.match(qname, qname.find("afun") + len("afun"))
+    if not m:
+        raise ValueError("Cannot parse query name [{}]".format(qname))
+    return int(m.group(1)), m.group(2), int(m.group(3)) if m.group(3) else 0
+
+def run_binary(args):
+    fin_bam = pysam.AlignmentFile(args.bam, "rb")
+    n_refs = fin_bam.nreferences
+    # per-reference columns: q_id, q_raw_len, q_length, r_start, r_end, q_start, q_end, mapping_quality, q_pos, direction
+    columns = [[array.array(tc) for tc in "Lllllllhcc"] for i in xrange(n_refs)]
+    if columns and (columns[0][0].itemsize != 8 or columns[0][1].itemsize != 8):
+        raise RuntimeError("binary brief_alignment requires 64-bit longs")
+    for aln in fin_bam.fetch(until_eof = True):
+        # the same records as InvDector::read_bam(); an unmapped read placed
+        # by its mate has a reference id but no reference end
+        if aln.is_unmapped or aln.is_secondary or aln.reference_id < 0:
+            continue
+        qname = aln.query_name
+        if args.modify_qname:
+            qname = modify_query_name(qname)
+        q_id, q_pos, q_raw_len = parse_query_name(qname)
+        cols = columns[ aln.reference_id ]
+        cols[0].append(q_id)
+        cols[1].append(q_raw_len)
+        cols[2].append(aln.query_length)
+        cols[3].append(aln.reference_start)
+        cols[4].append(aln.reference_end)
+        cols[5].append(aln.query_alignment_start)
+        cols[6].append(aln.query_alignment_end)
+        cols[7].append(aln.mapping_quality)
+        cols[8].append(q_pos)
+        cols[9].append('R' if aln.is_reverse else 'F')
+
+    names = [fin_bam.get_reference_name(i) for i in xrange(n_refs)]
+    lengths = fin_bam.lengths
+    offset = len(BINARY_MAGIC) + 8 + n_refs * 40
+    block_offsets = []
+    for cols in columns:
+        block_offsets.append( offset )
+        offset += (len(cols[0]) * 60 + 7) & ~7
+    with open(os.path.join(args.directory, "brief_alignment") if args.directory else "brief_alignment", "wb") as fout:
+        fout.write(BINARY_MAGIC)
+        fout.write(struct.pack("<Q", n_refs))
+        for i in xrange(n_refs):
+            fout.write(struct.pack("<QQqQQ", block_offsets[i], len(columns[i][0]), lengths[i], offset, len(names[i])))
+            offset += len(names[i])
+        for cols in columns:
+            for col in cols:
+                col.tofile(fout)
+            fout.write("\0" * (((len(cols[0]) * 60 + 7) & ~7) - len(cols[0]) * 60))
+        for name in names:
+            fout.write(name)
+    fin_bam.close()
+
 def run(args):
+    if args.binary:
+        run_binary(args)
+        return
     fin_bam = pysam.AlignmentFile(args.bam, "rb")
     fout = open(os.path.join(args.directory, "brief_alignment"), "w") if args.directory else sys.stdout
     # write total # of references
@@ -44,10 +116,7 @@ def run(args):
     for aln in fin_bam.fetch(until_eof = True):
         qname = aln.query_name
         if args.modify_qname:
-            qname = qname.split("/", 1)[0]
-            qname_tokens = qname.split("_")
-            qid = qname_tokens[0][qname_tokens[0].find("afun") + len("afun"):]
-            qname = "{}/{}/0_{}".format(qname, qid, int(qname_tokens[2])-1)
+            qname = modify_query_name(qname)
         fout.write("{} {} {} ".format(aln.reference_id, qname, aln.query_length))
         fout.write("{} {} {} {} {} {}\n".format(aln.reference_start, aln.reference_end, 
                 aln.query_alignment_start, aln.query_alignment_end,
@@ -66,6 +135,7 @@ def parse_args( argv = None ):
     #parser.add_argument("-r", "--read", required=True, help="long reads file (fasta/q)")
     parser.add_argument("-d", "--directory", help="directory of the output file. If not set, it will be output to stdout")
     parser.add_argument("-m", "--modify-qname", action="store_true", help="modify query name")
+    parser.add_argument("-B", "--binary", action="store_true", help="write the binary (columnar) brief_alignment file instead of text. If -d is not set, it will be written to ./brief_alignment")
     return parser.parse_args( argv )
 
 def main( argv = None ):
@@ -2,13 +2,10 @@
 
 import os
 import invdet
-from invdet import bamExtractor
 from invdet import peGenerator
-from invdet.invdet_core import InvDector
-from invdet.maxcut import MaxCut
+from invdet.invdet_core import InvDector, RepeatFinder, build_inverted_repeat_index
 import errno
 import logging
-import itertools
 import argparse
 import subprocess
 import pysam
@@ -31,11 +28,66 @@ def compose_subdirectory(index):
     return os.path.join(*sub_dirs)
     
 
+def nucmer_job_name(ref_ids):
+    # a job on a single reference keeps the file names of that reference
+    return str(ref_ids[0]) if len(ref_ids) == 1 else "batch.{}".format( ref_ids[0] )
+
+def nucmer_input_fname(nucmer_working_dir, ref_ids):
+    return os.path.join( nucmer_working_dir, compose_subdirectory( ref_ids[0] ), "nucmer-input.{}.fasta".format( nucmer_job_name(ref_ids) ) )
+
+def plan_nucmer_jobs(ref_lengths, batch_bases):
+    """Group the reference ids into nucmer jobs, the largest job first
+
+    A reference of at least `batch_bases` bases is a job by itself. The
+    smaller ones are packed, by decreasing length, into jobs of at most
+    `batch_bases` bases. The ids of a job are in increasing order.
+    """
+    jobs, batch, batch_size = [], [], 0
+    for i in sorted(xrange(len(ref_lengths)), key = lambda i: -ref_lengths[i]):
+        if ref_lengths[i] >= batch_bases:
+            jobs.append( [i] )
+            continue
+        if batch and batch_size + ref_lengths[i] > batch_bases:
+            jobs.append( sorted(batch) )
+            batch, batch_size = [], 0
+        batch.append( i )
+        batch_size += ref_lengths[i]
+    if batch:
+        jobs.append( sorted(batch) )
+    jobs.sort(key = lambda job: -sum(ref_lengths[i] for i in job))
+    return jobs
+
+def split_nucmer_delta(delta_fname, nucmer_working_dir, ref_ids):
+    """Split the delta file of a job on several references into nc_aln.<id>.delta
+
+    nucmer aligns every reference of the job to all the others; only the
+    alignments of a reference to itself are kept.
+    """
+    fouts = {}
+    try:
+        with open(delta_fname) as fin:
+            header = fin.readline() + fin.readline()    # the two sequence files and "NUCMER"
+            for i in ref_ids:
+                fouts[str(i)] = open(os.path.join( nucmer_working_dir, compose_subdirectory(i), "nc_aln.{}.delta".format(i) ), "w")
+                fouts[str(i)].write( header )
+            fout = None
+            for line in fin:
+                if line.startswith(">"):
+                    names = line[1:].split()
+                    fout = fouts.get( names[0] ) if names[0] == names[1] else None
+                if fout is not None:
+                    fout.write( line )
+    finally:
+        for fout in fouts.itervalues():
+            fout.close()
+
 def nucmer_task(params, logger=None):
-    nucmer_input_dirname = os.path.join( params[1], compose_subdirectory( params[2] ) )
-    log_fname = os.path.join( nucmer_input_dirname, "nucmer.{}.log".format( params[2]) )
-    prefix = os.path.join( nucmer_input_dirname, "nc_aln.{}".format( params[2] ) )
-    infile_name = os.path.join( nucmer_input_dirname, "nucmer-input.{}.fasta".format( params[2] ) )
+    ref_ids = params[2]
+    job_name = nucmer_job_name( ref_ids )
+    nucmer_input_dirname = os.path.join( params[1], compose_subdirectory( ref_ids[0] ) )
+    log_fname = os.path.join( nucmer_input_dirname, "nucmer.{}.log".format( job_name ) )
+    prefix = os.path.join( nucmer_input_dirname, "nc_aln.{}".format( job_name ) )
+    infile_name = nucmer_input_fname( params[1], ref_ids )
     with open(log_fname, "wb") as fout_nclog:
         child_process = subprocess.Popen( params[0] + ["--prefix", prefix, infile_name, infile_name], stderr = fout_nclog )
         ret_code = child_process.wait()
@@ -45,10 +97,12 @@ def nucmer_task(params, logger=None):
                 raise subprocess.CalledProcessError(ret_code, params[0] + ["--prefix", prefix, infile_name, infile_name])
             else:
                 raise RuntimeError("[ERROR]: Run Nucmer failed. See `{}` for more details. ret_code = {}, command = {}".format( log_fname, ret_code, str(params[0] + ["--prefix", prefix, infile_name, infile_name])))
+    if len(ref_ids) > 1:
+        split_nucmer_delta( prefix + ".delta", params[1], ref_ids )
 
 
 def parse_args(argv = None):
-    stage_list = ["begin", "blasr", "extract", "inv-repeats", "report"]
+    stage_list = ["begin", "blasr", "inv-repeats", "report"]
     parser = argparse.ArgumentParser(description = "Inversion Dector")
     parser.add_argument("-d", "--working-directory", default="working_dir", help="working directory (default: %(default)s)")
     parser.add_argument("-t", "--target-genome", help="Target genome file (fasta file)")
@@ -57,20 +111,30 @@ def parse_args(argv = None):
     parser.add_argument("-o", "--only", action="store_true", help="Run the chosen stage only")
     parser.add_argument("-S", "--chosen-stages", action="append", choices=stage_list, help="Choose a stage or stages to run")
     parser.add_argument("--strategy", default="ignore-IR", choices=["naive", "ignore-IR", "extract-IR"], help="Choose a strategy (default: %(default)s) ('IR' stands for 'Inverted Repeats'; 'extract-IR' has not been implemented yet)")
+    parser.add_argument("--ir-finder", default="nucmer", choices=["nucmer", "builtin"], help="find the inverted repeats with nucmer runs on all the references, or with the built-in minimizer search, run by the report stage on the references that need them; the built-in search needs no nucmer but its repeats are close to, not the same as, those of nucmer (default: %(default)s); both use the --nc-minmatch, --nc-mincluster, --nc-maxgap and --nc-diagdiff options")
+    parser.add_argument("--ir-window", default=10, type=int, help="built-in inverted repeat finder option: number of consecutive k-mers sampled by one minimizer (default: %(default)s)")
     parser.add_argument("-V", "--version", action='version', version=('%(prog)s ' + invdet.__version__))
     parser.add_argument("--min-coverage", default=0, type=int, help="min coverage for filtering poor alignments (default: %(default)s)")
     parser.add_argument("--min-percent", default=0.2, type=float, help="min percentage of coverage for filtering poor alignments (default: %(default)s)")
     parser.add_argument("--min-overlap", default=80, type=int, help="min overlap for determining the overlaped regions (default: %(default)s)")
-    parser.add_argument("--small-graph", default=15, type=int, help="max number of vertices for small graph (default: %(default)s)")
-    parser.add_argument("--max-nodes", default=60, type=int, help="max number of vertices that can run on with 0.878-approx algorithm (default: %(default)s)")
+    parser.add_argument("--small-graph", default=15, type=int, help="max number of vertices for small graph, which is solved exactly; up to the mid-20s stays fast (default: %(default)s)")
+    parser.add_argument("--refine-passes", default=20, type=int, help="max number of local search passes improving the cut of each graph above --small-graph; 0 disables it (default: %(default)s)")
+    parser.add_argument("--bb-time", default=0.0, type=float, help="seconds of branch and bound for each graph above --small-graph, before the 0.878-approx algorithm; the budget is per graph, so it may add this much time for every such graph; 0 disables it (default: %(default)s)")
+    parser.add_argument("--bb-max-nodes", default=80, type=int, help="max number of vertices for branch and bound (default: %(default)s)")
+    parser.add_argument("--max-nodes", default=5000, type=int, help="max number of vertices that can run on with 0.878-approx algorithm, on a low-rank SDP (default: %(default)s)")
     parser.add_argument("--min-iter", default=100, type=int, help="min iterations for running 0.878-approx algorithm (default: %(default)s)")
     parser.add_argument("--max-iter", default=10000, type=int, help="max iterations for running 0.878-approx algorithm (default: %(default)s)")
     parser.add_argument("--min-ratio", default=0.878, type=float, help="min approx ratio for the 0.878-approx algorithm (default: %(default)s)")
     parser.add_argument("--max-ratio", default=0.995, type=float, help="max approx ratio for the 0.878-approx algorithm (default: %(default)s)")
+    parser.add_argument("--maxcut-cache", help="file caching the max-cut of each graph across runs of the report stage; a graph solved before with the same max-cut options is not solved again; only the cuts proven optimal are cached unless --maxcut-cache-all is given")
+    parser.add_argument("--maxcut-cache-all", action="store_true", help="also cache the cuts of the heuristics, which depend on the time limits (--bb-time) and on the machine that found them")
+    parser.add_argument("--alignments", help="alignments for the report stage: a BAM file or a binary brief_alignment file (default: <working-directory>/pe_reads.bam)")
+    parser.add_argument("--streaming", action="store_true", help="run the report stage one reference at a time to bound the memory usage; the alignments must be sorted by reference (a coordinate-sorted BAM or a binary brief_alignment file)")
+    parser.add_argument("--keep-graphs", action="store_true", help="also write the graphs and their max-cuts to [graph_file] and [graph_cut] in the working directory for debugging")
     parser.add_argument("--log", action="store_true", help="save log to file [invdet.log] instead of printing in the console")
     
     # blasr/nucmer options
-    parser.add_argument("-j", "--nproc", default=1, type=int, help="BLASR/NUCmer option: number of threads (default: %(default)s)")
+    parser.add_argument("-j", "--nproc", default=1, type=int, help="BLASR/NUCmer/BAM-reading option: number of threads (default: %(default)s)")
 
     # blasr options
     parser.add_argument("--minMatch", type=int, default=20, help="BLASR option: minimum seed length (default: %(default)s)")
@@ -86,6 +150,7 @@ def parse_args(argv = None):
     parser.add_argument("--nc-diagfactor", type=float, default=0.12, help="Nucmer option: set the maximum diagonal difference between two adjacent anchors in a cluster as a differential fraction of the gap length (default: %(default)s)")
     parser.add_argument("--nc-maxgap", type=int, default=90, help="Nucmer option: set the maximum gap between two adjacent matches in a cluster (default: %(default)s)")
     parser.add_argument("--nc-minmatch", type=int, default=20, help="Nucmer option: Set the minimum length of a single match (default: %(default)s)")
+    parser.add_argument("--nc-batch-bases", type=int, default=1000000, help="references shorter than this are packed together into nucmer runs of at most this many bases (default: %(default)s)")
 
     return parser.parse_args( argv )
 
@@ -129,15 +194,32 @@ def run_blasr(args, logger):
     logger.debug("blasr parameter: {}".format(str(blasr_command)))
     subprocess.check_call(blasr_command)
 
+def load_repeat_finder(args, logger):
+    # nucmer's minimum match length is the k-mer size, as far as 64-bit k-mers go
+    finder = RepeatFinder(min(args.nc_minmatch, 31), args.ir_window, args.nc_mincluster, args.nc_maxgap, args.nc_diagdiff)
+    if args.target_genome.endswith(".gz"):
+        # a compressed genome cannot be mapped: it is kept in memory
+        with pysam.FastxFile(args.target_genome) as fh:
+            for entry in fh:
+                finder.add_reference(entry.sequence)
+    else:
+        finder.open_fasta(args.target_genome)
+    logger.info("loaded {} targets for the built-in inverted repeat finder".format( len(finder) ))
+    return finder
+
 def run_inv_repeats(args, logger):
     if args.strategy == "naive":
         return
-    logger.info("[inv-repeats] Extract inverted repeats using Nucmer")
-    nucmer_working_dir = os.path.join( args.working_directory, "nucmer" )
-    makedir( nucmer_working_dir )
     if not args.target_genome:
         logger.critical("-t/--target-genome is missing")
         exit(-1)
+    if args.ir_finder == "builtin":
+        # searched by the report stage, only for the references whose reads may give an edge
+        logger.info("[inv-repeats] Inverted repeats will be found by the built-in finder in the report stage")
+        return
+    logger.info("[inv-repeats] Extract inverted repeats using Nucmer")
+    nucmer_working_dir = os.path.join( args.working_directory, "nucmer" )
+    makedir( nucmer_working_dir )
     nucmer_command = ["nucmer", "--maxmatch", "--reverse"]
     if args.nc_breaklen != 200:
         addCmdParameter(nucmer_command, "-b", args.nc_breaklen)
@@ -152,31 +234,40 @@ def run_inv_repeats(args, logger):
     #addCmdParameter(nucmer_command, args.target_genome, args.target_genome)
     logger.debug("numcer parameters: {}".format(str(nucmer_command)))
 
-    n_refs = 0
+    ref_lengths = []
     with pysam.FastxFile(args.target_genome) as fh:
         for entry in fh:
-            nucmer_input_dirname = os.path.join(nucmer_working_dir, compose_subdirectory(n_refs))
-            makedir(nucmer_input_dirname)
-            with open(os.path.join(nucmer_input_dirname, "nucmer-input.{}.fasta".format(n_refs)), "w") as fout:
-                fout.write(">{}\n".format( n_refs ))
+            ref_lengths.append( len(entry.sequence) )
+    n_refs = len(ref_lengths)
+    jobs = plan_nucmer_jobs(ref_lengths, args.nc_batch_bases)
+    job_of_ref = [None] * n_refs
+    for job in jobs:
+        for i in job:
+            job_of_ref[i] = job
+    with pysam.FastxFile(args.target_genome) as fh:
+        for i, entry in enumerate(fh):
+            makedir(os.path.join(nucmer_working_dir, compose_subdirectory(i)))
+            # the references of a job are written in increasing order, starting with job[0]
+            with open(nucmer_input_fname(nucmer_working_dir, job_of_ref[i]), "w" if job_of_ref[i][0] == i else "a") as fout:
+                fout.write(">{}\n".format( i ))
                 fout.write(entry.sequence)
                 fout.write("\n")
-            n_refs += 1
     with open(os.path.join( nucmer_working_dir, "n_refs.txt"), "w") as fout:
         fout.write("{}\n".format( n_refs ))
-    nthreads = min(n_refs, args.nproc)
+    nthreads = min(len(jobs), args.nproc)
     if nthreads <= 1:
-        logger.info("run nucmer with single thread on {} targets".format( n_refs ))
-        for i in xrange( n_refs ):
-            nucmer_task( [nucmer_command, nucmer_working_dir, i], logger )
+        logger.info("run nucmer with single thread on {} targets in {} jobs".format( n_refs, len(jobs) ))
+        for job in jobs:
+            nucmer_task( [nucmer_command, nucmer_working_dir, job], logger )
     else:
-        task_params = [(nucmer_command, nucmer_working_dir, i) for i in xrange(n_refs)]
+        task_params = [(nucmer_command, nucmer_working_dir, job) for job in jobs]
         original_sigint_handler = signal.signal( signal.SIGINT, signal.SIG_IGN )
         pool = multiprocessing.Pool( nthreads )
         signal.signal( signal.SIGINT, original_sigint_handler )
         
-        logger.info("run nucmer with {} threads on {} targets, with blocksize={}".format(nthreads, n_refs, min(128, n_refs/nthreads)))
-        res = pool.map_async(nucmer_task, task_params, min(128, n_refs/nthreads))
+        # one job at a time, so that the big jobs at the front are spread over the workers
+        logger.info("run nucmer with {} threads on {} targets in {} jobs".format(nthreads, n_refs, len(jobs)))
+        res = pool.map_async(nucmer_task, task_params, 1)
         while True:
             try:
                 res.get(0x7fffffff)
@@ -194,49 +285,51 @@ def run_inv_repeats(args, logger):
                 pool.close()
                 break
         pool.join()
-    
-def run_extract(args, logger): 
-    logger.info("[extract] Extract alignments from BAM file")
-    bamExtractor.main(["-b", os.path.join(args.working_directory, "pe_reads.bam"), "-d", args.working_directory])
 
+    logger.info("index the inverted repeats of {} targets".format( n_refs ))
+    build_inverted_repeat_index(nucmer_working_dir, n_refs,
+            os.path.join(args.working_directory, "inv_repeats.idx"), args.nproc)
+    
 def run_report(args, logger):
     logger.info("[report] Generate report")
-    logger.info("generate graph")
     inv_dector = InvDector()
-    brief_alignment = os.path.join( args.working_directory, "brief_alignment")
-    graph_file = os.path.join( args.working_directory, "graph_file")
-    inv_dector.read( brief_alignment )
-    if args.strategy == "ignore-IR":
-        inv_dector.gen_graphs_ignore_inverted_repeats(graph_file, os.path.join(args.working_directory, "nucmer"), args.min_coverage, args.min_percent, args.min_overlap)
-    elif args.strategy == "naive":
-        inv_dector.gen_graphs(graph_file, args.min_coverage, args.min_percent, args.min_overlap)
-    else: # "extract-IR"
+    inv_dector.set_maxcut_params(args.small_graph, args.max_nodes, args.min_iter, args.max_iter, args.min_ratio, args.max_ratio, args.bb_time, args.bb_max_nodes, args.refine_passes)
+    if args.maxcut_cache:
+        inv_dector.set_maxcut_cache(args.maxcut_cache, args.maxcut_cache_all)
+    alignments = args.alignments if args.alignments else os.path.join(args.working_directory, "pe_reads.bam")
+    # graph_file and graph_cut are only kept for debugging
+    graph_file = os.path.join(args.working_directory, "graph_file") if args.keep_graphs else ""
+    graph_cut = os.path.join(args.working_directory, "graph_cut") if args.keep_graphs else ""
+    inversion_report = os.path.join(args.working_directory, "inversion.report")
+    if args.strategy == "extract-IR":
         logger.error("The strategy 'extract-IR' has not been implemented yet! Please choose another strategy")
         exit(1)
+    nucmer_prefix = os.path.join(args.working_directory, "nucmer") if args.strategy == "ignore-IR" else ""
+    if nucmer_prefix and args.ir_finder == "builtin":
+        if not args.target_genome:
+            logger.critical("-t/--target-genome is missing")
+            exit(-1)
+        inv_dector.set_repeat_finder( load_repeat_finder(args, logger) )
+        nucmer_prefix = ""
+    elif nucmer_prefix and os.path.isfile(os.path.join(args.working_directory, "inv_repeats.idx")):
+        # written by run_inv_repeats instead of reading every delta file
+        nucmer_prefix = os.path.join(args.working_directory, "inv_repeats.idx")
 
-    logger.info("run max-cut")
-    graph_cut = os.path.join(args.working_directory, "graph_cut")
-    fout = open(graph_cut, "w")
-    with open(graph_file, "r") as fin:
-        while True:
-            line = fin.readline()
-            if not line: break
-            line = line.split()
-            n, r_id = int(line[0]), line[1]
-            graph = MaxCut(args.small_graph, args.max_nodes)
-            for i in xrange(n):
-                line = fin.readline().split()
-                graph.add_edge(int(line[0]), int(line[1]), int(line[2]))
-            graph.solve(args.min_iter, args.max_iter, args.min_ratio, args.max_ratio)
-            fout.write("{} {}\n".format(graph.number_of_nodes(), r_id))
-                
-            for node_name, sol in itertools.izip(graph.node_name_iter(), graph.get_solution()):
-                fout.write("{} {}\n".format(node_name, 1 if sol else 0))
-    fout.close()
+    if args.streaming:
+        logger.info("generate graphs, run max-cut and deduce inversions reference by reference")
+        inv_dector.stream_report(alignments, graph_file, graph_cut, inversion_report, nucmer_prefix,
+                args.min_coverage, args.min_percent, args.min_overlap, args.nproc)
+        return
+
+    logger.info("load alignments")
+    if alignments.endswith(".bam"):
+        inv_dector.read_bam( alignments, args.nproc )
+    else:
+        inv_dector.read( alignments )
 
-    logger.info("Deduce inversions")
-    inv_dector.report_inversions(graph_file, graph_cut,
-            os.path.join(args.working_directory, "inversion.report"));
+    logger.info("generate graphs, run max-cut and deduce inversions")
+    inv_dector.report(graph_file, graph_cut, inversion_report, nucmer_prefix,
+            args.min_coverage, args.min_percent, args.min_overlap, args.nproc)
     
 
 def main(argv = None):
@@ -250,12 +343,11 @@ def main(argv = None):
     logger = logging.getLogger()
     logger.info("Start")
 
-    func_list = [run_begin, run_blasr, run_extract, run_inv_repeats, run_report]
+    func_list = [run_begin, run_blasr, run_inv_repeats, run_report]
     func_indices = {"begin": 0, 
                     "blasr": 1, 
-                    "extract": 2, 
-                    "inv-repeats": 3, 
-                    "report": 4}
+                    "inv-repeats": 2, 
+                    "report": 3}
     if args.only:
         stage_ids = set()
         for each in args.chosen_stages:
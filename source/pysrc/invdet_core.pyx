@@ -1,27 +1,138 @@
 from libcpp.string cimport string
+from libcpp cimport bool as bool_t
+
+cdef extern from "repeat_finder.h" namespace "loon":
+    cdef cppclass CppRepeatFinder "loon::RepeatFinder":
+        CppRepeatFinder(int k, int w, int min_cluster, int max_gap, int diag_diff, int max_occ) except +RuntimeError
+        void add_reference(const string& seq) except +RuntimeError
+        void open_fasta(const string& fname) except +RuntimeError
+        size_t size() const
+        void write_index(const string& fname, int n_threads) except +RuntimeError nogil
 
 cdef extern from "invdet_core.h" namespace "loon":
     cdef cppclass CppInvDector "loon::InvDector":
         void read(const string& fname) except +RuntimeError
+        void read_bam(const string& fname, int n_threads) except +RuntimeError
+        void write_binary(const string& fname) except +RuntimeError
 
-        void gen_graphs(const string& fname, int min_cvg, double min_cvg_percent, int min_overlap) except +RuntimeError
-        void gen_graphs(const string& fname, int min_cvg, double min_cvg_percent, int min_overlap, const string& nucmer_prefix) except +RuntimeError
+        void gen_graphs(const string& fname, int min_cvg, double min_cvg_percent, int min_overlap,
+                const string& nucmer_prefix, int n_threads) except +RuntimeError nogil
         
         void report_inversions(const string& graph_fname, const string& maxcut_fname,
-                const string& inversion_fname) except +RuntimeError
+                const string& inversion_fname, int n_threads) except +RuntimeError nogil
+
+        void set_refinement(int max_passes, double seconds)
+        void set_branch_and_bound(double seconds, int max_nodes)
+        void set_sdp(int max_nodes, int min_iter, int max_iter, double min_ratio, double max_ratio)
+        void set_repeat_finder(const CppRepeatFinder* finder)
+        void set_maxcut_cache(const string& fname, bool_t all_cuts) except +RuntimeError
+        void report(const string& graph_fname, const string& maxcut_fname,
+                const string& inversion_fname,
+                int min_cvg, double min_cvg_percent, int min_overlap,
+                const string& nucmer_prefix, int small_threshold, int n_threads) except +RuntimeError nogil
+        void stream_report(const string& aln_fname, const string& graph_fname,
+                const string& maxcut_fname, const string& inversion_fname,
+                int min_cvg, double min_cvg_percent, int min_overlap,
+                const string& nucmer_prefix, int small_threshold, int n_threads) except +RuntimeError nogil
+
+cdef extern from "repeat_index.h" namespace "loon":
+    cdef cppclass CppRepeatIndexFile "loon::RepeatIndexFile":
+        @staticmethod
+        void build(const string& fname, const string& nucmer_prefix,
+                size_t n_refs, int n_threads) except +RuntimeError nogil
+
+def build_inverted_repeat_index(str nucmer_prefix, size_t n_refs, str fname, int n_threads = 1):
+    # pack the nucmer delta files of references [0, n_refs) into one index,
+    # which can be passed as `nucmer_prefix` to the report stage
+    cdef string c_prefix = nucmer_prefix, c_fname = fname
+    with nogil:
+        CppRepeatIndexFile.build(c_fname, c_prefix, n_refs, n_threads)
+
+cdef class RepeatFinder:
+    # finds the inverted repeats of the references in process, instead of nucmer
+    cdef CppRepeatFinder* _finder
+
+    def __cinit__(self, int k = 20, int w = 10, int min_cluster = 65, int max_gap = 90, int diag_diff = 5, int max_occ = 500):
+        self._finder = new CppRepeatFinder(k, w, min_cluster, max_gap, diag_diff, max_occ)
+
+    def __dealloc__(self):
+        del self._finder
+
+    def add_reference(self, str seq):
+        self._finder.add_reference(<string>seq)
+
+    # search the references of an uncompressed FASTA file, reading each one
+    # only while it is searched
+    def open_fasta(self, str fname):
+        self._finder.open_fasta(<string>fname)
+
+    def __len__(self):
+        return self._finder.size()
+
+    # write the inverted repeats of all the references as an index for the report stage
+    def write_index(self, str fname, int n_threads = 1):
+        cdef string c_fname = fname
+        with nogil:
+            self._finder.write_index(c_fname, n_threads)
 
 cdef class InvDector:
     cdef CppInvDector _invdet
+    cdef int _small_graph
+    cdef RepeatFinder _repeat_finder
+
+    def __cinit__(self):
+        self.set_maxcut_params()
+
+    def set_maxcut_params(self, int small_graph = 15, int max_nodes = 5000, int min_iteration = 100, int max_iteration = 10000, float min_ratio = 0.878, float max_ratio = 0.995, double bb_time = 0.0, int bb_max_nodes = 80, int refine_passes = 20):
+        self._small_graph = small_graph
+        self._invdet.set_refinement(refine_passes, 0)
+        # the SDP only runs on the graphs branch and bound leaves unsolved
+        self._invdet.set_branch_and_bound(bb_time, bb_max_nodes)
+        self._invdet.set_sdp(max_nodes, min_iteration, max_iteration, min_ratio, max_ratio)
+
+    # find the inverted repeats with `finder` instead of reading them from
+    # nucmer_prefix, only for the references that need them; None undoes it
+    def set_repeat_finder(self, RepeatFinder finder):
+        self._repeat_finder = finder
+        self._invdet.set_repeat_finder(finder._finder if finder is not None else NULL)
+
+    # reuse the cuts of the graphs solved by earlier runs with the same max-cut
+    # parameters, kept in the file `fname`; "" closes the cache. Only the cuts
+    # proven optimal are cached, unless all_cuts.
+    def set_maxcut_cache(self, str fname, bint all_cuts = False):
+        self._invdet.set_maxcut_cache(<string>fname, all_cuts)
 
     def read(self, str fname):
         self._invdet.read(<string>fname)
 
-    def gen_graphs(self, str fname, int min_cvg = 0, double min_cvg_percent = 0.0, int min_overlap=0):
-        self._invdet.gen_graphs(<string>fname, min_cvg, min_cvg_percent, min_overlap)
+    def read_bam(self, str fname, int n_threads = 1):
+        self._invdet.read_bam(<string>fname, n_threads)
+
+    def write_binary(self, str fname):
+        self._invdet.write_binary(<string>fname)
+
+    def gen_graphs(self, str fname, int min_cvg = 0, double min_cvg_percent = 0.0, int min_overlap=0, int n_threads = 1):
+        self.gen_graphs_ignore_inverted_repeats(fname, "", min_cvg, min_cvg_percent, min_overlap, n_threads)
+
+    def gen_graphs_ignore_inverted_repeats(self, str fname, str nucmer_prefix, int min_cvg = 0, double min_cvg_percent = 0.0, int min_overlap=0, int n_threads = 1):
+        cdef string c_fname = fname, c_prefix = nucmer_prefix
+        with nogil:
+            self._invdet.gen_graphs(c_fname, min_cvg, min_cvg_percent, min_overlap, c_prefix, n_threads)
 
-    def gen_graphs_ignore_inverted_repeats(self, str fname, str nucmer_prefix, int min_cvg = 0, double min_cvg_percent = 0.0, int min_overlap=0):
-        self._invdet.gen_graphs(<string>fname, min_cvg, min_cvg_percent, min_overlap, <string>nucmer_prefix)
+    def report_inversions(self, str graph_fname, str maxcut_fname, str inversion_fname, int n_threads = 1):
+        cdef string c_graph = graph_fname, c_maxcut = maxcut_fname, c_inversion = inversion_fname
+        with nogil:
+            self._invdet.report_inversions(c_graph, c_maxcut, c_inversion, n_threads)
 
-    def report_inversions(self, str graph_fname, str maxcut_fname, str inversion_fname):
-        self._invdet.report_inversions( <string>graph_fname, <string>maxcut_fname, <string>inversion_fname )
+    # graph_fname and maxcut_fname may be "" to skip the debug outputs
+    def report(self, str graph_fname, str maxcut_fname, str inversion_fname, str nucmer_prefix = "", int min_cvg = 0, double min_cvg_percent = 0.0, int min_overlap = 0, int n_threads = 1):
+        cdef string c_graph = graph_fname, c_maxcut = maxcut_fname, c_inversion = inversion_fname, c_prefix = nucmer_prefix
+        with nogil:
+            self._invdet.report(c_graph, c_maxcut, c_inversion,
+                    min_cvg, min_cvg_percent, min_overlap, c_prefix, self._small_graph, n_threads)
 
+    def stream_report(self, str aln_fname, str graph_fname, str maxcut_fname, str inversion_fname, str nucmer_prefix = "", int min_cvg = 0, double min_cvg_percent = 0.0, int min_overlap = 0, int n_threads = 1):
+        cdef string c_aln = aln_fname, c_graph = graph_fname, c_maxcut = maxcut_fname, c_inversion = inversion_fname, c_prefix = nucmer_prefix
+        with nogil:
+            self._invdet.stream_report(c_aln, c_graph, c_maxcut, c_inversion,
+                    min_cvg, min_cvg_percent, min_overlap, c_prefix, self._small_graph, n_threads)
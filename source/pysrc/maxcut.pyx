@@ -1,11 +1,7 @@
 from libcpp.string cimport string
 from libcpp.vector cimport vector
 from libcpp cimport bool as bool_t
-import picos as pic
 import networkx as nx
-import cvxopt as cvx
-import cvxopt.lapack
-import numpy as np
 
 cdef extern from "maxcut.h" namespace "loon":
     cdef cppclass CppMaxCut "loon::MaxCut":
@@ -13,7 +9,13 @@ cdef extern from "maxcut.h" namespace "loon":
         MaxCut(int threshold) except+
         void clear()
         void set_small_threshold(int threshold)
+        void set_n_threads(int threads)
+        void set_refinement(int max_passes, double seconds)
+        void set_branch_and_bound(double seconds, int max_nodes)
+        void set_sdp(int max_nodes, int min_iter, int max_iter, double min_ratio, double max_ratio)
+        void set_seed(unsigned long long s)
         void add_edge(int u, int v, int w)
+        unsigned long long fingerprint() const
         Py_ssize_t number_of_nodes() const
         Py_ssize_t number_of_edges() const
         int get_edge_u(Py_ssize_t i) const
@@ -22,10 +24,32 @@ cdef extern from "maxcut.h" namespace "loon":
         int get_node_rawid(Py_ssize_t i) const
         const vector[bool_t]& get_solution() const
         double get_value() const
+        double get_upper_bound() const
+        double get_sdp_value() const
         bool_t solve()
         bool_t is_bipartite()
         bool_t exact_algorithm()
         void max_spanning_tree()
+        void refine()
+        void low_rank_sdp(int min_iter, int max_iter, double min_ratio, double max_ratio) nogil
+
+cdef extern from "maxcut_batch.h" namespace "loon":
+    cdef cppclass CppMaxCutBatch "loon::MaxCutBatch":
+        CppMaxCutBatch(int threshold) except +
+        void clear()
+        CppMaxCut& get_settings()
+        void set_cache(const string& fname, bool_t all_cuts) except +RuntimeError
+        size_t add_graph(int ref_id)
+        void add_edge(size_t i, int u, int v, int w)
+        void read(const string& graph_fname) except +RuntimeError
+        void solve(int n_threads) except +RuntimeError nogil
+        void write(const string& maxcut_fname) except +RuntimeError
+        size_t size() const
+        int get_ref_id(size_t i) const
+        const vector[int]& get_nodes(size_t i) const
+        const vector[bool_t]& get_solution(size_t i) const
+        double get_value(size_t i) const
+        bool_t is_optimal(size_t i) const
 
 cdef class MaxCut:
     cdef CppMaxCut _maxcut
@@ -33,7 +57,7 @@ cdef class MaxCut:
     cdef list _solution
     cdef int _maxnode
 
-    def __cinit__(self, threshold = 15, maxnode = 60):
+    def __cinit__(self, threshold = 15, maxnode = 5000):
         self._maxcut.set_small_threshold(threshold)
         self._value = float("-inf")
         self._maxnode = maxnode
@@ -44,6 +68,23 @@ cdef class MaxCut:
     def set_small_threshold(self, int threshold):
         self._maxcut.set_small_threshold(threshold)
 
+    def set_n_threads(self, int threads):
+        self._maxcut.set_n_threads(threads)
+
+    def set_refinement(self, int max_passes, double seconds = 0):
+        self._maxcut.set_refinement(max_passes, seconds)
+
+    def refine(self):
+        self._maxcut.refine()
+        self._value = self._maxcut.get_value()
+        self._solution = self._maxcut.get_solution()
+
+    def set_branch_and_bound(self, double seconds, int max_nodes = 80):
+        self._maxcut.set_branch_and_bound(seconds, max_nodes)
+
+    def get_upper_bound(self):
+        return self._maxcut.get_upper_bound()
+
     def set_sdp_maxnode(self, int maxnode):
         self._maxnode = maxnode
 
@@ -162,40 +203,96 @@ cdef class MaxCut:
                     weight=self._maxcut.get_edge_w(i))
         return G
 
+    def set_seed(self, unsigned long long seed):
+        self._maxcut.set_seed(seed)
+
+    # hash of the edges and the solver settings, the key of the max-cut cache
+    def fingerprint(self):
+        return self._maxcut.fingerprint()
+
+    def get_sdp_value(self):
+        return self._maxcut.get_sdp_value()
+
     cpdef approx_878(self, int min_iter = 100, int max_iter = 10000, float min_ratio = 0.878, float max_ratio = 0.995):
-        cdef int N, i, j, cnt
-        cdef float obj_sdp, obj, o
-        G = self.build_graph()
-        N = self.number_of_nodes()
-        maxcut = pic.Problem()
-        X = maxcut.add_variable('X', (N, N), 'symmetric')
-        t_mat = 1/4.*nx.laplacian_matrix(G, nodelist=range(N))
-        t_mat = t_mat.tocoo()
-        L = pic.new_param('L', cvx.spmatrix(t_mat.data.tolist(), t_mat.row.tolist(), 
-                t_mat.col.tolist(), size=t_mat.shape))
-        maxcut.add_constraint(pic.tools.diag_vect(X) == 1)
-        maxcut.add_constraint(X>>0)
-        maxcut.set_objective('max', L|X)
-        maxcut.solve(verbose = 0)
-        V = X.value # Cholesky factorization
-        cvxopt.lapack.potrf(V)
-        for i in xrange(N):
-            for j in xrange(i+1, N):
-                V[i, j] = 0
-        cnt = 0
-        obj_sdp = maxcut.obj_value()
-        obj = 0.0
-        while (cnt < min_iter or (obj < min_ratio*obj_sdp and cnt < max_iter) ):
-            r = cvx.normal(N, 1)
-            x = cvx.matrix(np.sign(V * r))
-            o = (x.T*L*x).value[0]
-            if o > obj:
-                x_cut = x
-                obj = o
-            cnt += 1
-            if obj >= max_ratio * obj_sdp:
-                break
-        #print "Iterations: ", cnt
-        self._solution = [(False if each == -1 else True) for each in x_cut]
-        self._value = obj
-        
+        # Goemans-Williamson rounding of the low-rank SDP solved by the C++ MaxCut,
+        # on set_n_threads() threads; the current solution is kept if it is better
+        # the limits only hold for this call, not for solve() or fingerprint()
+        with nogil:
+            self._maxcut.low_rank_sdp(min_iter, max_iter, min_ratio, max_ratio)
+        self._value = self._maxcut.get_value()
+        self._solution = self._maxcut.get_solution()
+
+cdef class MaxCutBatch:
+    # the graphs of all the references, solved together by the C++ threads
+    cdef CppMaxCutBatch* _batch
+
+    def __cinit__(self, int threshold = 15):
+        self._batch = new CppMaxCutBatch(threshold)
+
+    def __dealloc__(self):
+        del self._batch
+
+    def clear(self):
+        self._batch.clear()
+
+    def set_refinement(self, int max_passes, double seconds = 0):
+        self._batch.get_settings().set_refinement(max_passes, seconds)
+
+    def set_branch_and_bound(self, double seconds, int max_nodes = 80):
+        self._batch.get_settings().set_branch_and_bound(seconds, max_nodes)
+
+    def set_sdp(self, int max_nodes, int min_iteration = 100, int max_iteration = 10000, double min_ratio = 0.878, double max_ratio = 0.995):
+        self._batch.get_settings().set_sdp(max_nodes, min_iteration, max_iteration, min_ratio, max_ratio)
+
+    def set_seed(self, unsigned long long seed):
+        self._batch.get_settings().set_seed(seed)
+
+    # look up the cuts in the cache file `fname` before solving, and add the
+    # new ones to it at the end of solve(); "" closes the cache. Only the cuts
+    # proven optimal are cached, unless all_cuts.
+    def set_cache(self, str fname, bint all_cuts = False):
+        self._batch.set_cache(<string>fname, all_cuts)
+
+    # edges: (u, v, w) triples; returns the index of the graph
+    def add_graph(self, int ref_id, edges):
+        cdef size_t i = self._batch.add_graph(ref_id)
+        cdef int u, v, w
+        for u, v, w in edges:
+            self._batch.add_edge(i, u, v, w)
+        return i
+
+    def read(self, str graph_fname):
+        self._batch.read(<string>graph_fname)
+
+    def solve(self, int n_threads = 1):
+        with nogil:
+            self._batch.solve(n_threads)
+
+    def write(self, str maxcut_fname):
+        self._batch.write(<string>maxcut_fname)
+
+    def __len__(self):
+        return self._batch.size()
+
+    cdef check_index(self, size_t i):
+        if i >= self._batch.size():
+            raise IndexError("graph index out of range")
+
+    def get_ref_id(self, size_t i):
+        self.check_index(i)
+        return self._batch.get_ref_id(i)
+
+    # {node: side} of the i-th graph
+    def get_solution(self, size_t i):
+        self.check_index(i)
+        cdef const vector[int]* nodes = &self._batch.get_nodes(i)
+        cdef const vector[bool_t]* sol = &self._batch.get_solution(i)
+        return {nodes[0][k]: sol[0][k] for k in xrange(nodes.size())}
+
+    def get_value(self, size_t i):
+        self.check_index(i)
+        return self._batch.get_value(i)
+
+    def is_optimal(self, size_t i):
+        self.check_index(i)
+        return self._batch.is_optimal(i)
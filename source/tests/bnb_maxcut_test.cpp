@@ -0,0 +1,118 @@
+// MaxCut::branch_and_bound() must find the cut of brute-force enumeration
+// when it claims optimality, and its upper bound must never be below the
+// optimum, whether it is called directly, through solve() or stopped by its
+// time budget.
+#include <random>
+#include <vector>
+#include <stdint.h>
+#include "maxcut.h"
+#include "check.h"
+
+using namespace loon;
+
+namespace
+{
+
+// the weight of the edges of `graph` across `sides`
+int64_t cut_value(const MaxCut& graph, const std::vector<bool>& sides)
+{
+    int64_t cut = 0;
+    for(size_t i = 0; i < graph.number_of_edges(); ++i)
+        if(sides[ graph.get_edge_u(i) ] != sides[ graph.get_edge_v(i) ])
+            cut += graph.get_edge_w(i);
+    return cut;
+}
+
+// the best cut over all 2^N sides
+int64_t brute_force(const MaxCut& graph)
+{
+    size_t N = graph.number_of_nodes();
+    std::vector<bool> sides(N);
+    int64_t best = 0;
+    for(uint64_t mask = 0; mask < (uint64_t(1) << N); ++mask)
+    {
+        for(size_t i = 0; i < N; ++i)
+            sides[i] = (mask >> i) & 1;
+        int64_t cut = cut_value(graph, sides);
+        if(cut > best)  best = cut;
+    }
+    return best;
+}
+
+// `n_edges` edges on nodes 0, 1, ..., n_nodes - 1, a third of them negative
+void random_graph(std::mt19937& rng, int n_nodes, int n_edges, std::vector<int>& edges)
+{
+    edges.clear();
+    for(int i = 0; i + 1 < n_nodes; ++i) // a path, so that every node occurs
+    {
+        edges.push_back(i);
+        edges.push_back(i + 1);
+        edges.push_back(1 + rng() % 5);
+    }
+    for(int j = 0; j < n_edges; ++j)
+    {
+        int w = 1 + rng() % 20;
+        edges.push_back(rng() % n_nodes);   // loops and parallel edges too
+        edges.push_back(rng() % n_nodes);
+        edges.push_back(rng() % 3 == 0 ? -w : w);
+    }
+}
+
+void load(const std::vector<int>& edges, MaxCut& graph)
+{
+    graph.clear();
+    for(size_t j = 0; j < edges.size(); j += 3)
+        graph.add_edge( edges[j], edges[j + 1], edges[j + 2] );
+}
+
+}// anonymous namespace
+
+int main()
+{
+    std::mt19937 rng(17);
+    std::vector<int> edges;
+    MaxCut direct, through_solve(4);
+    direct.set_branch_and_bound(5, 80);
+    through_solve.set_branch_and_bound(5, 80);
+    for(int round = 0; round < 300; ++round)
+    {
+        int n_nodes = 2 + round % 13;
+        random_graph( rng, n_nodes, rng() % (3 * n_nodes), edges );
+        load( edges, direct );
+        int64_t best = brute_force(direct);
+
+        CHECK(direct.branch_and_bound());
+        CHECK(direct.get_value() == best);
+        CHECK(direct.get_upper_bound() == best);
+        CHECK(cut_value(direct, direct.get_solution()) == direct.get_value());
+
+        load( edges, through_solve );
+        bool optimal = through_solve.solve();
+        CHECK(cut_value(through_solve, through_solve.get_solution()) == through_solve.get_value());
+        CHECK(through_solve.get_value() <= best);
+        CHECK(through_solve.get_upper_bound() >= best);
+        if(optimal)
+            CHECK(through_solve.get_value() == best);
+    }
+
+    // cut short by the budget, against the optimum of a full run
+    MaxCut hurried, patient;
+    hurried.set_branch_and_bound(1e-9, 80);
+    patient.set_branch_and_bound(60, 80);
+    int n_timeouts = 0;
+    for(int round = 0; round < 20; ++round)
+    {
+        int n_nodes = 28 + round % 8;
+        random_graph( rng, n_nodes, 3 * n_nodes, edges );
+        load( edges, patient );
+        CHECK(patient.branch_and_bound());
+        load( edges, hurried );
+        if(! hurried.branch_and_bound())
+            ++n_timeouts;
+        CHECK(cut_value(hurried, hurried.get_solution()) == hurried.get_value());
+        CHECK(hurried.get_value() <= patient.get_value());
+        CHECK(hurried.get_upper_bound() >= patient.get_value());
+    }
+    CHECK(n_timeouts >= 10);
+    return 0;
+}
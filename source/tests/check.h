@@ -0,0 +1,18 @@
+#ifndef __TESTS_CHECK_H
+#define __TESTS_CHECK_H
+
+#include <iostream>
+#include <cstdlib>
+
+// stop the test with the failed condition; unlike assert(), kept under NDEBUG
+#define CHECK(cond) \
+    do \
+    { \
+        if(!(cond)) \
+        { \
+            std::cerr << __FILE__ << ':' << __LINE__ << ": check failed: " #cond << std::endl; \
+            std::exit(1); \
+        } \
+    } while(0)
+
+#endif
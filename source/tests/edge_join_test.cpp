@@ -0,0 +1,203 @@
+// The edges of random regions, counted by Region::gen_edges() after the read
+// join of make_pairs(), must match the std::map/std::set code they replaced,
+// which wrote only the edges of weight above 5.
+#include <algorithm>
+#include <map>
+#include <sstream>
+#include <random>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "region.h"
+#include "check.h"
+
+using namespace loon;
+
+namespace
+{
+
+struct Aln
+{
+    size_t q_id;
+    char q_pos;
+    long long q_length, r_start, r_end;
+    char dir;
+    bool is_valid() const { return q_length > 0; }
+};
+
+// valid alignments first, by r_start, longest first
+bool aln_less(const Aln& a, const Aln& b)
+{
+    if(a.is_valid() != b.is_valid())    return a.is_valid();
+    if(a.r_start != b.r_start)  return a.r_start < b.r_start;
+    return a.r_end > b.r_end;
+}
+
+// the graph written by the code before the edge hash and the sorted read join
+std::string old_graph(std::vector<Aln> alns, int min_overlap, const InvertedRepeats* inv_repeats,
+        size_t r_id, bool& has_edges)
+{
+    std::stable_sort( alns.begin(), alns.end(), aln_less );
+    std::vector<long long> segs_end;
+    std::vector<size_t> seg_ids;
+    for(size_t i = 0; i < alns.size(); ++i)
+    {
+        if(! alns[i].is_valid())
+        {
+            alns.resize(i);
+            break;
+        }
+        if(segs_end.empty() || segs_end.back() <= alns[i].r_start + min_overlap)
+            segs_end.push_back( alns[i].r_end );
+        else if(segs_end.back() < alns[i].r_end)
+            segs_end.back() = alns[i].r_end;
+        seg_ids.push_back( segs_end.size() - 1 );
+    }
+
+    std::map<size_t, std::vector<size_t> > pair_5, pair_3, all_5, all_3;
+    for(size_t i = 0; i < alns.size(); ++i)
+    {
+        (alns[i].q_pos == '5' ? all_5 : all_3)[ alns[i].q_id ].push_back(i);
+        if(inv_repeats && inv_repeats->contained( alns[i].r_start, alns[i].r_end ))
+            continue;
+        (alns[i].q_pos == '5' ? pair_5 : pair_3)[ alns[i].q_id ].push_back(i);
+    }
+
+    std::map<std::pair<size_t, size_t>, size_t> edges, all_edges;
+    for(int pass = 0; pass < 2; ++pass)
+    {
+        std::map<size_t, std::vector<size_t> >& p5 = (pass == 0 ? all_5 : pair_5);
+        std::map<size_t, std::vector<size_t> >& p3 = (pass == 0 ? all_3 : pair_3);
+        std::map<std::pair<size_t, size_t>, size_t>& e = (pass == 0 ? all_edges : edges);
+        for(std::map<size_t, std::vector<size_t> >::iterator it5 = p5.begin(); it5 != p5.end(); ++it5)
+        {
+            std::map<size_t, std::vector<size_t> >::iterator it3 = p3.find( it5->first );
+            if(it3 == p3.end()) continue;
+            for(size_t a = 0; a < it5->second.size(); ++a)
+            {
+                for(size_t b = 0; b < it3->second.size(); ++b)
+                {
+                    size_t u = it5->second[a], v = it3->second[b];
+                    if(seg_ids[u] == seg_ids[v] || (alns[u].dir == 'F') == (alns[v].dir == 'F'))
+                        continue;
+                    ++e[ std::make_pair( std::min(seg_ids[u], seg_ids[v]), std::max(seg_ids[u], seg_ids[v]) ) ];
+                }
+            }
+        }
+    }
+    has_edges = ! all_edges.empty();
+
+    const size_t min_weight = 5;
+    size_t edge_count = 0;
+    std::map<std::pair<size_t, size_t>, size_t>::const_iterator it;
+    for(it = edges.begin(); it != edges.end(); ++it)
+        if(it->second > min_weight)
+            ++edge_count;
+    std::ostringstream out;
+    if(edge_count > 0)
+    {
+        out << edge_count << ' ' << r_id << std::endl;
+        for(it = edges.begin(); it != edges.end(); ++it)
+            if(it->second > min_weight)
+                out << it->first.first << ' ' << it->first.second << ' ' << it->second << std::endl;
+    }
+    return out.str();
+}
+
+// `n_reads` reads with up to 3 alignments at each end, some of them invalid,
+// each end within one of `n_sites` sites 2000 bp apart
+void random_alns(std::mt19937& rng, size_t n_reads, size_t n_sites, std::vector<Aln>& alns)
+{
+    alns.clear();
+    for(size_t q = 0; q < n_reads; ++q)
+    {
+        size_t q_id = rng() % (n_reads * 2);    // sparse ids, some reads split in two
+        for(int end = 0; end < 2; ++end)
+        {
+            int n_ends = rng() % 4;
+            for(int k = 0; k < n_ends; ++k)
+            {
+                Aln a;
+                a.q_id = q_id;
+                a.q_pos = (end == 0 ? '5' : '3');
+                a.q_length = (rng() % 10 == 0 ? 0 : 100 + rng() % 400);
+                a.r_start = (rng() % n_sites) * 2000 + rng() % 300;
+                a.r_end = a.r_start + 100 + rng() % (rng() % 400 == 0 ? 3000 : 300);
+                a.dir = (rng() % 2 ? 'F' : 'R');
+                alns.push_back(a);
+                if(rng() % 8 == 0)  // a duplicate, which must land in the same segment
+                    alns.push_back(a);
+            }
+        }
+    }
+}
+
+// `n` repeats sorted by (start, end)
+void random_repeats(std::mt19937& rng, size_t n, long long r_length, InvertedRepeats& inv_repeats)
+{
+    std::vector< std::pair<uint64_t, uint64_t> > reps;
+    for(size_t i = 0; i < n; ++i)
+    {
+        uint64_t s = rng() % r_length;
+        reps.push_back( std::make_pair(s, s + 200 + rng() % 3000) );
+    }
+    std::sort( reps.begin(), reps.end() );
+    std::vector<uint64_t> starts, ends;
+    for(size_t i = 0; i < reps.size(); ++i)
+    {
+        starts.push_back( reps[i].first );
+        ends.push_back( reps[i].second );
+    }
+    inv_repeats.assign( starts.empty() ? NULL : &starts[0], ends.empty() ? NULL : &ends[0], reps.size() );
+}
+
+}// anonymous namespace
+
+int main()
+{
+    std::mt19937 rng(2024);
+    Region region;
+    std::vector<Aln> alns;
+    InvertedRepeats inv_repeats;
+    const size_t n_reads[] = {0, 1, 5, 40, 300, 3000};
+    const int min_overlaps[] = {0, 20, 50};
+    size_t n_graphs = 0;
+    for(int round = 0; round < 120; ++round)
+    {
+        size_t r_id = round;
+        size_t n_sites = 2 + rng() % 40;
+        long long r_length = n_sites * 2000;
+        int min_overlap = min_overlaps[ round % 3 ];
+        bool with_repeats = (round % 2 == 1);
+        random_alns( rng, n_reads[ round % 6 ], n_sites, alns );
+        if(with_repeats)
+            random_repeats( rng, rng() % 10, r_length, inv_repeats );
+
+        bool old_has_edges = false;
+        std::string expected = old_graph( alns, min_overlap, with_repeats ? &inv_repeats : NULL, r_id, old_has_edges );
+
+        region.clear();
+        for(size_t i = 0; i < alns.size(); ++i)
+            region.push_back( alns[i].q_id, alns[i].q_pos, alns[i].q_length + 50, alns[i].q_length,
+                    alns[i].r_start, alns[i].r_end, 0, alns[i].q_length, 60, alns[i].dir );
+        region.gen_vertices( min_overlap );
+        bool has_edges = region.make_pairs();
+        CHECK(has_edges == old_has_edges);
+        if(has_edges && with_repeats)
+            region.filter_pairs( inv_repeats );
+        std::vector<VertexPair> edges;
+    #ifdef FOR_NORA_EXAMINATION
+        std::ostringstream out_graph_bridge;
+        region.gen_edges( edges, r_id, out_graph_bridge );
+    #else
+        region.gen_edges( edges );
+    #endif
+        std::ostringstream out;
+        Region::write_graph( r_id, edges, out );
+        CHECK(out.str() == expected);
+        if(! expected.empty())
+            ++n_graphs;
+    }
+    CHECK(n_graphs >= 20);
+    return 0;
+}
@@ -0,0 +1,90 @@
+// MaxCut::exact_algorithm() must find the cut of brute-force enumeration on
+// small random graphs with loops, parallel edges and negative weights, and
+// give the same cut value with several threads.
+#include <random>
+#include <vector>
+#include <stdint.h>
+#include "maxcut.h"
+#include "check.h"
+
+using namespace loon;
+
+namespace
+{
+
+// the weight of the edges of `graph` across `sides`
+int64_t cut_value(const MaxCut& graph, const std::vector<bool>& sides)
+{
+    int64_t cut = 0;
+    for(size_t i = 0; i < graph.number_of_edges(); ++i)
+        if(sides[ graph.get_edge_u(i) ] != sides[ graph.get_edge_v(i) ])
+            cut += graph.get_edge_w(i);
+    return cut;
+}
+
+// the best cut over all 2^N sides
+int64_t brute_force(const MaxCut& graph)
+{
+    size_t N = graph.number_of_nodes();
+    std::vector<bool> sides(N);
+    int64_t best = 0;
+    for(uint64_t mask = 0; mask < (uint64_t(1) << N); ++mask)
+    {
+        for(size_t i = 0; i < N; ++i)
+            sides[i] = (mask >> i) & 1;
+        int64_t cut = cut_value(graph, sides);
+        if(cut > best)  best = cut;
+    }
+    return best;
+}
+
+// `n_edges` edges on raw ids 100, 101, ..., 100 + n_nodes - 1
+void random_graph(std::mt19937& rng, int n_nodes, int n_edges, bool negative, MaxCut& graph)
+{
+    graph.clear();
+    for(int i = 0; i + 1 < n_nodes; ++i) // a path, so that every node occurs
+        graph.add_edge( 100 + i, 100 + i + 1, 1 + rng() % 5 );
+    for(int j = 0; j < n_edges; ++j)
+    {
+        int u = rng() % n_nodes, v = rng() % n_nodes;   // loops and parallel edges too
+        int w = 1 + rng() % 20;
+        if(negative && rng() % 3 == 0)
+            w = -w;
+        graph.add_edge( 100 + u, 100 + v, w );
+    }
+}
+
+}// anonymous namespace
+
+int main()
+{
+    std::mt19937 rng(16);
+    MaxCut graph(64);
+    for(int round = 0; round < 400; ++round)
+    {
+        int n_nodes = 2 + round % 13;
+        random_graph( rng, n_nodes, rng() % (3 * n_nodes), round % 2 == 1, graph );
+        CHECK(graph.exact_algorithm());
+        CHECK(graph.get_solution().size() == graph.number_of_nodes());
+        CHECK(graph.get_value() == brute_force(graph));
+        CHECK(cut_value(graph, graph.get_solution()) == graph.get_value());
+    }
+
+    // large enough to split the enumeration between the threads
+    MaxCut parallel(64);
+    parallel.set_n_threads(4);
+    for(int round = 0; round < 3; ++round)
+    {
+        int n_nodes = 21;
+        random_graph( rng, n_nodes, 2 * n_nodes, true, graph );
+        parallel.clear();
+        for(size_t i = 0; i < graph.number_of_edges(); ++i)
+            parallel.add_edge( graph.get_node_rawid( graph.get_edge_u(i) ),
+                    graph.get_node_rawid( graph.get_edge_v(i) ), graph.get_edge_w(i) );
+        CHECK(graph.exact_algorithm());
+        CHECK(parallel.exact_algorithm());
+        CHECK(parallel.get_value() == graph.get_value());
+        CHECK(cut_value(parallel, parallel.get_solution()) == parallel.get_value());
+    }
+    return 0;
+}
@@ -0,0 +1,137 @@
+// MaxCutCache must give back the cuts it wrote, keep optimal cuts over the
+// others, and ignore a record cut short at the end of the file.
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <unistd.h>
+#include "maxcut.h"
+#include "maxcut_cache.h"
+#include "check.h"
+
+using namespace loon;
+
+namespace
+{
+
+long file_size(const char* fname)
+{
+    std::ifstream fin(fname, std::ios::binary | std::ios::ate);
+    return fin.is_open() ? long(fin.tellg()) : -1;
+}
+
+}// anonymous namespace
+
+int main()
+{
+    const char* fname = "maxcut.cache";
+    ::unlink(fname);
+    std::vector<bool> small(3), big(130), got;
+    small[0] = small[2] = true;
+    for(size_t i = 0; i < big.size(); i += 3)
+        big[i] = true;
+    double value;
+    bool optimal;
+
+    {// by default, only the optimal cuts are written
+        MaxCutCache cache;
+        cache.open(fname);
+        CHECK(cache.is_open());
+        cache.add(1, 11, small, 5, true);
+        cache.add(2, 22, big, 7, false);
+        CHECK(cache.size() == 1);
+        cache.close();
+        CHECK(! cache.is_open());
+    }
+    {// a record needs its key, its check and its number of nodes to match
+        MaxCutCache cache;
+        cache.open(fname);
+        CHECK(cache.size() == 1);
+        CHECK(cache.find(1, 11, 3, got, value, optimal));
+        CHECK(got == small && value == 5 && optimal);
+        CHECK(! cache.find(1, 12, 3, got, value, optimal));
+        CHECK(! cache.find(1, 11, 4, got, value, optimal));
+        CHECK(! cache.find(2, 22, 130, got, value, optimal));
+    }
+    {// all_cuts writes the other cuts too, over several words of sides
+        MaxCutCache cache;
+        cache.open(fname, true);
+        cache.add(2, 22, big, 7, false);
+        cache.add(3, 33, small, 1, true);
+        cache.close();
+    }
+    {// but they are only used with all_cuts
+        MaxCutCache cache;
+        cache.open(fname);
+        CHECK(cache.size() == 3);
+        CHECK(! cache.find(2, 22, 130, got, value, optimal));
+        cache.close();
+        cache.open(fname, true);
+        CHECK(cache.find(2, 22, 130, got, value, optimal));
+        CHECK(got == big && value == 7 && ! optimal);
+        // an optimal cut replaces the one that is not, but not the other way round
+        cache.add(2, 22, small, 9, true);
+        cache.add(3, 33, big, 0, false);
+        cache.close();
+        cache.open(fname);
+        CHECK(cache.find(2, 22, 3, got, value, optimal));
+        CHECK(got == small && value == 9 && optimal);
+        CHECK(cache.find(3, 33, 3, got, value, optimal));
+        CHECK(got == small && value == 1 && optimal);
+    }
+
+    {// the record cut short is ignored, then overwritten by the next flush
+        long n_bytes = file_size(fname);
+        CHECK(::truncate(fname, n_bytes - 5) == 0);
+        MaxCutCache cache;
+        cache.open(fname);
+        CHECK(! cache.find(2, 22, 3, got, value, optimal));
+        CHECK(cache.find(3, 33, 3, got, value, optimal));
+        cache.add(4, 44, small, 2, true);
+        cache.flush();
+        cache.close();
+        cache.open(fname);
+        CHECK(cache.find(4, 44, 3, got, value, optimal) && value == 2);
+        CHECK(cache.find(1, 11, 3, got, value, optimal) && value == 5);
+        CHECK(cache.find(3, 33, 3, got, value, optimal) && value == 1);
+        cache.close();
+        // the record cut short was dropped before the one of the same size was appended
+        CHECK(file_size(fname) == n_bytes);
+    }
+
+    {// a solved graph is found again under its fingerprint
+        MaxCut graph;
+        for(int i = 0; i < 10; ++i)
+            graph.add_edge(i, (i * 7 + 3) % 10, 1 + i % 4);
+        CHECK(graph.solve());
+        uint64_t check;
+        uint64_t key = graph.fingerprint(&check);
+        MaxCutCache cache;
+        cache.open(fname);
+        cache.add(key, check, graph.get_solution(), graph.get_value(), true);
+        cache.close();
+        cache.open(fname);
+        CHECK(cache.find(key, check, graph.number_of_nodes(), got, value, optimal));
+        CHECK(got == graph.get_solution() && value == graph.get_value() && optimal);
+    }
+
+    {// a file of something else is refused
+        std::ofstream fout(fname, std::ios::binary | std::ios::trunc);
+        fout << "not a cache";
+        fout.close();
+        MaxCutCache cache;
+        bool thrown = false;
+        try
+        {
+            cache.open(fname);
+        }
+        catch(const std::runtime_error&)
+        {
+            thrown = true;
+        }
+        CHECK(thrown);
+    }
+    ::unlink(fname);
+    return 0;
+}
@@ -0,0 +1,152 @@
+// MaxCut::solve() with a small exact threshold goes through the reductions of
+// nodes of degree <= 2 and the split into blocks; its cuts must be no better
+// than the exact cut, and equal to it whenever they are claimed optimal. Its
+// upper bound must be no worse than the exact cut.
+#include <random>
+#include <vector>
+#include <stdint.h>
+#include "maxcut.h"
+#include "check.h"
+
+using namespace loon;
+
+namespace
+{
+
+struct Edge
+{
+    int u, v, w;
+};
+
+int64_t cut_value(const std::vector<Edge>& edges, const MaxCut& graph)
+{
+    // the solution is indexed by the labels of the nodes in `graph`
+    std::vector<int> label;
+    for(size_t i = 0; i < graph.number_of_nodes(); ++i)
+    {
+        int raw = graph.get_node_rawid(i);
+        if(raw >= int(label.size()))
+            label.resize(raw + 1, -1);
+        label[raw] = i;
+    }
+    const std::vector<bool>& sides = graph.get_solution();
+    int64_t cut = 0;
+    for(size_t j = 0; j < edges.size(); ++j)
+        if(sides[ label[ edges[j].u ] ] != sides[ label[ edges[j].v ] ])
+            cut += edges[j].w;
+    return cut;
+}
+
+int random_weight(std::mt19937& rng)
+{
+    int w = 1 + rng() % 20;
+    return (rng() % 3 == 0 ? -w : w);
+}
+
+// blocks of 3 to 6 nodes hanging from each other by a cut node, chains and
+// leaves, then a few edges across the blocks in some rounds
+void random_graph(std::mt19937& rng, int n_nodes, int n_extra, std::vector<Edge>& edges)
+{
+    edges.clear();
+    int n = 1;
+    while(n < n_nodes)
+    {
+        int at = rng() % n;
+        int kind = rng() % 3;
+        if(kind == 0)   // a chain of 1 to 3 nodes, closed into a cycle or not
+        {
+            int len = 1 + rng() % 3, prev = at;
+            for(int i = 0; i < len && n < n_nodes; ++i, ++n)
+            {
+                edges.push_back( Edge{prev, n, random_weight(rng)} );
+                prev = n;
+            }
+            if(prev != at && rng() % 2)
+                edges.push_back( Edge{prev, at, random_weight(rng)} );
+        }
+        else            // a block: a cycle through `at` and chords
+        {
+            int k = 2 + rng() % 4, first = n, prev = at;
+            for(int i = 0; i < k && n < n_nodes; ++i, ++n)
+            {
+                edges.push_back( Edge{prev, n, random_weight(rng)} );
+                prev = n;
+            }
+            edges.push_back( Edge{prev, at, random_weight(rng)} );
+            for(int c = rng() % 4; c > 0; --c)
+            {
+                int u = first + rng() % (n - first), v = first + rng() % (n - first);
+                edges.push_back( Edge{(rng() % 2 ? at : u), v, random_weight(rng)} );
+            }
+        }
+    }
+    for(int j = 0; j < n_extra; ++j)
+        edges.push_back( Edge{int(rng() % n_nodes), int(rng() % n_nodes), random_weight(rng)} );
+}
+
+void load(const std::vector<Edge>& edges, MaxCut& graph)
+{
+    graph.clear();
+    for(size_t j = 0; j < edges.size(); ++j)
+        graph.add_edge( edges[j].u, edges[j].v, edges[j].w );
+}
+
+}// anonymous namespace
+
+int main()
+{
+    std::mt19937 rng(21);
+    std::vector<Edge> edges;
+    MaxCut exact(64), reused(6);
+    int n_optimal = 0;
+    for(int round = 0; round < 300; ++round)
+    {
+        int n_nodes = 8 + round % 11;
+        random_graph( rng, n_nodes, (round % 4 == 3 ? rng() % 4 : 0), edges );
+        load( edges, exact );
+        CHECK(exact.exact_algorithm());
+        CHECK(cut_value(edges, exact) == exact.get_value());
+
+        MaxCut fresh(6);
+        load( edges, fresh );
+        bool optimal = fresh.solve();
+        CHECK(cut_value(edges, fresh) == fresh.get_value());
+        CHECK(fresh.get_value() <= exact.get_value());
+        CHECK(fresh.get_upper_bound() >= exact.get_value());
+        if(optimal)
+        {
+            CHECK(fresh.get_value() == exact.get_value());
+            CHECK(fresh.get_upper_bound() == fresh.get_value());
+            ++n_optimal;
+        }
+
+        // a solver reused through clear() gives the same cut
+        load( edges, reused );
+        CHECK(reused.solve() == optimal);
+        CHECK(reused.get_value() == fresh.get_value());
+        CHECK(reused.get_solution() == fresh.get_solution());
+    }
+    CHECK(n_optimal >= 250);
+
+    // denser graphs, whose kernels and blocks go on to branch and bound
+    MaxCut bounded(4);
+    bounded.set_branch_and_bound(5, 80);
+    for(int round = 0; round < 200; ++round)
+    {
+        int n_nodes = 8 + round % 9;
+        random_graph( rng, n_nodes, rng() % n_nodes, edges );
+        load( edges, exact );
+        CHECK(exact.exact_algorithm());
+        load( edges, bounded );
+        bool optimal = bounded.solve();
+        CHECK(cut_value(edges, bounded) == bounded.get_value());
+        CHECK(bounded.get_value() <= exact.get_value());
+        CHECK(bounded.get_upper_bound() >= exact.get_value());
+        if(optimal)
+        {
+            CHECK(bounded.get_value() == exact.get_value());
+            CHECK(bounded.get_upper_bound() == bounded.get_value());
+        }
+    }
+    return 0;
+}
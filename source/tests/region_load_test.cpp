@@ -0,0 +1,199 @@
+// The text, binary and BAM loaders must give the same regions: the binary
+// files written back from each of them are compared byte by byte.
+#include <fstream>
+#include <sstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <zlib.h>
+#include "invdet_core.h"
+#include "check.h"
+
+using namespace loon;
+
+namespace
+{
+
+struct Record
+{
+    int ref_id;
+    std::string name;
+    long long q_length, r_start, r_end, q_start, q_end;
+    int score;
+    char dir;
+};
+
+void put32(std::string& buf, uint32_t x)
+{
+    for(int i = 0; i < 4; ++i)
+        buf += char((x >> (8 * i)) & 0xFF);
+}
+
+void put16(std::string& buf, uint16_t x)
+{
+    buf += char(x & 0xFF);
+    buf += char(x >> 8);
+}
+
+// the BAM record of `r`, with soft clips around one match; `flag` is added
+std::string bam_record(const Record& r, uint16_t flag)
+{
+    std::vector<uint32_t> cigar;
+    if(r.q_start > 0)   cigar.push_back( (uint32_t(r.q_start) << 4) | 4 );
+    cigar.push_back( (uint32_t(r.r_end - r.r_start) << 4) | 0 );
+    if(r.q_length > r.q_end)    cigar.push_back( (uint32_t(r.q_length - r.q_end) << 4) | 4 );
+
+    std::string body;
+    put32(body, r.ref_id);
+    put32(body, uint32_t(r.r_start));
+    body += char(r.name.size() + 1);
+    body += char(r.score);
+    put16(body, 0);     // bin
+    put16(body, cigar.size());
+    put16(body, (r.dir == 'R' ? 16 : 0) | flag);
+    put32(body, uint32_t(r.q_length));
+    put32(body, uint32_t(-1));  // mate
+    put32(body, uint32_t(-1));
+    put32(body, 0);
+    body += r.name;
+    body += '\0';
+    for(size_t i = 0; i < cigar.size(); ++i)
+        put32(body, cigar[i]);
+    body += std::string((r.q_length + 1) / 2, '\0');    // sequence
+    body += std::string(r.q_length, '\xFF');            // qualities
+    std::string rec;
+    put32(rec, body.size());
+    return rec + body;
+}
+
+// BGZF: raw deflate blocks with the BC extra field, then the empty EOF block
+void write_bgzf(const std::string& fname, const std::string& data)
+{
+    std::ofstream fout(fname.c_str(), std::ios::binary);
+    std::vector<unsigned char> comp(70000);
+    for(size_t pos = 0; pos <= data.size(); pos += 65280)
+    {
+        size_t n = std::min<size_t>(65280, data.size() - pos);
+        z_stream zs = z_stream();
+        CHECK(deflateInit2(&zs, 6, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+        zs.next_in = (Bytef*)(data.data() + pos);
+        zs.avail_in = n;
+        zs.next_out = &comp[0];
+        zs.avail_out = comp.size();
+        CHECK(deflate(&zs, Z_FINISH) == Z_STREAM_END);
+        size_t comp_size = zs.total_out;
+        deflateEnd(&zs);
+
+        std::string block("\x1f\x8b\x08\x04\0\0\0\0\0\xff\x06\0BC\x02\0", 16);
+        put16(block, comp_size + 25);
+        block.append((const char*)&comp[0], comp_size);
+        put32(block, crc32(0, (const Bytef*)(data.data() + pos), n));
+        put32(block, n);
+        fout.write(block.data(), block.size());
+        if(n == 0)  break;  // the empty block is the EOF marker
+    }
+    CHECK(fout.good());
+}
+
+std::string read_file(const std::string& fname)
+{
+    std::ifstream fin(fname.c_str(), std::ios::binary);
+    CHECK(fin.is_open());
+    return std::string(std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+}
+
+}// anonymous namespace
+
+int main()
+{
+    std::mt19937 rng(17);
+    const int n_refs = 6;
+    std::vector<long long> ref_length;
+    for(int i = 0; i < n_refs; ++i)
+        ref_length.push_back(20000 + rng() % 50000);
+
+    std::vector<Record> records;
+    for(int q = 0; q < 3000; ++q)
+    {
+        int ref_id = rng() % n_refs;
+        if(ref_id == 2) continue;   // a reference without reads
+        for(int end = 0; end < 2; ++end)
+        {
+            Record r;
+            r.ref_id = ref_id;
+            r.q_length = 500 + rng() % 3000;
+            r.q_start = rng() % 40;
+            r.q_end = r.q_length - rng() % 40;
+            r.r_start = rng() % (ref_length[ref_id] - r.q_length);
+            r.r_end = r.r_start + (r.q_end - r.q_start);
+            r.score = rng() % 61;
+            r.dir = (rng() % 4 == 0 ? 'R' : 'F');
+            std::ostringstream name;
+            name << "afun" << q << '_' << (end == 0 ? '5' : '3') << '_' << 3 * r.q_length << '/' << q << "/0_" << r.q_length;
+            r.name = name.str();
+            records.push_back(r);
+        }
+    }
+
+    std::ofstream txt("alns.txt");
+    txt << n_refs << '\n';
+    for(int i = 0; i < n_refs; ++i)
+        txt << ref_length[i] << " chr" << i << '\n';
+    for(size_t k = 0; k < records.size(); ++k)
+    {
+        const Record& r = records[k];
+        txt << r.ref_id << ' ' << r.name << ' ' << r.q_length << ' ' << r.r_start << ' ' << r.r_end << ' '
+            << r.q_start << ' ' << r.q_end << ' ' << r.score << ' ' << r.dir << '\n';
+    }
+    txt.close();
+
+    std::string bam("BAM\1", 4);
+    std::string header("@HD\tVN:1.5\n");
+    put32(bam, header.size());
+    bam += header;
+    put32(bam, n_refs);
+    for(int i = 0; i < n_refs; ++i)
+    {
+        std::ostringstream name;
+        name << "chr" << i;
+        put32(bam, name.str().size() + 1);
+        bam += name.str();
+        bam += '\0';
+        put32(bam, ref_length[i]);
+    }
+    for(size_t k = 0; k < records.size(); ++k)
+    {
+        bam += bam_record(records[k], 0);
+        if(k % 97 == 0) // secondary alignments are skipped
+            bam += bam_record(records[k], 0x100);
+        if(k % 89 == 0) // and so are unmapped reads
+        {
+            Record unmapped = records[k];
+            unmapped.ref_id = -1;
+            bam += bam_record(unmapped, 0x4);
+        }
+    }
+    write_bgzf("alns.bam", bam);
+
+    {
+        InvDector d;
+        d.read("alns.txt");
+        d.write_binary("from_text.bin");
+    }
+    {
+        InvDector d;
+        d.read("from_text.bin");
+        d.write_binary("from_binary.bin");
+    }
+    for(int n_threads = 1; n_threads <= 3; n_threads += 2)
+    {
+        InvDector d;
+        d.read_bam("alns.bam", n_threads);
+        d.write_binary("from_bam.bin");
+        CHECK(read_file("from_bam.bin") == read_file("from_text.bin"));
+    }
+    CHECK(read_file("from_binary.bin") == read_file("from_text.bin"));
+    return 0;
+}
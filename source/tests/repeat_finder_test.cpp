@@ -0,0 +1,126 @@
+// RepeatFinder must find the inverted repeats planted in random sequences,
+// and find the same ones whatever the number of threads.
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+#include "repeat_finder.h"
+#include "check.h"
+
+using namespace loon;
+
+namespace
+{
+
+struct Planted
+{
+    size_t start, length;   // one arm; the reverse complement of the other arm
+};
+
+std::string reverse_complement(const std::string& seq)
+{
+    std::string rc(seq.rbegin(), seq.rend());
+    for(size_t i = 0; i < rc.size(); ++i)
+    {
+        switch(rc[i])
+        {
+            case 'A': rc[i] = 'T'; break;
+            case 'C': rc[i] = 'G'; break;
+            case 'G': rc[i] = 'C'; break;
+            case 'T': rc[i] = 'A'; break;
+        }
+    }
+    return rc;
+}
+
+// a random sequence with `n_pairs` inverted repeats, a few of them with
+// substitutions every 150 to 250 bases; `arms` gets both arms of each
+std::string planted_sequence(std::mt19937& rng, size_t length, int n_pairs, std::vector<Planted>& arms)
+{
+    const char bases[] = "ACGT";
+    std::string seq(length, 'A');
+    for(size_t i = 0; i < length; ++i)
+        seq[i] = bases[ rng() % 4 ];
+    arms.clear();
+    size_t slot = length / n_pairs;
+    for(int r = 0; r < n_pairs; ++r)
+    {
+        size_t len = 200 + rng() % 1800;
+        size_t a = r * slot + rng() % 1000;
+        size_t b = a + len + 500 + rng() % (slot - 2 * len - 2000);
+        std::string arm = reverse_complement( seq.substr(a, len) );
+        if(r % 3 == 2)
+            for(size_t i = 150 + rng() % 100; i < len; i += 150 + rng() % 100)
+                arm[i] = (arm[i] == 'A' ? 'C' : 'A');
+        seq.replace(b, len, arm);
+        Planted pa = {a, len}, pb = {b, len};
+        arms.push_back(pa);
+        arms.push_back(pb);
+    }
+    return seq;
+}
+
+// |x - y| < d
+bool near(size_t x, size_t y, size_t d)
+{
+    return x < y + d && y < x + d;
+}
+
+void check_found(const InvertedRepeats& repeats, const std::vector<Planted>& arms, int w)
+{
+    // each arm is covered from its first window to its last one; the bases
+    // around the arms are random, so a few of them may match too
+    const size_t slack = 2 * w;
+    for(size_t x = 0; x < arms.size(); ++x)
+    {
+        bool found = false;
+        for(size_t i = 0; i < repeats.r_starts.size() && ! found; ++i)
+            found = (near(repeats.r_starts[i], arms[x].start, slack) &&
+                    near(repeats.r_ends[i], arms[x].start + arms[x].length, slack));
+        CHECK(found);
+    }
+    // and nothing is found out of the arms
+    for(size_t i = 0; i < repeats.r_starts.size(); ++i)
+    {
+        bool inside = false;
+        for(size_t x = 0; x < arms.size() && ! inside; ++x)
+            inside = (repeats.r_starts[i] + slack > arms[x].start &&
+                    repeats.r_ends[i] < arms[x].start + arms[x].length + slack);
+        CHECK(inside);
+    }
+}
+
+bool same_repeats(const InvertedRepeats& a, const InvertedRepeats& b)
+{
+    return a.r_starts == b.r_starts && a.r_ends == b.r_ends;
+}
+
+}// anonymous namespace
+
+int main()
+{
+    std::mt19937 rng(13);
+    const int w = 10;
+    RepeatFinder finder(20, w);
+    std::vector< std::vector<Planted> > arms(3);
+    // the first reference is sketched in several tasks of 2^20 windows
+    finder.add_reference( planted_sequence(rng, 2500000, 12, arms[0]) );
+    finder.add_reference( planted_sequence(rng, 60000, 3, arms[1]) );
+    finder.add_reference( planted_sequence(rng, 30000, 1, arms[2]) );
+
+    std::vector<InvertedRepeats> one, several;
+    finder.find_all(one, 1);
+    CHECK(one.size() == 3);
+    for(size_t r = 0; r < one.size(); ++r)
+        check_found(one[r], arms[r], w);
+
+    finder.find_all(several, 4);
+    CHECK(several.size() == 3);
+    for(size_t r = 0; r < one.size(); ++r)
+        CHECK(same_repeats(one[r], several[r]));
+
+    InvertedRepeats split;
+    finder.find(0, split, 3);
+    CHECK(same_repeats(one[0], split));
+    return 0;
+}
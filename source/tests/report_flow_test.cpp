@@ -0,0 +1,115 @@
+// InvDector::report() and InvDector::stream_report() must write the same
+// graph_file, graph_cut and inversion report as the three passes of
+// gen_graphs(), MaxCutBatch and report_inversions(), with 1 and 4 threads.
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "invdet_core.h"
+#include "maxcut_batch.h"
+#include "check.h"
+
+using namespace loon;
+
+namespace
+{
+
+std::string read_file(const std::string& fname)
+{
+    std::ifstream fin(fname.c_str(), std::ios::binary);
+    CHECK(fin.is_open());
+    return std::string(std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+}
+
+// Reads whose two ends fall on sites 3000 bp apart along each reference; the
+// sites are flipped at random, as if inverted, and so are a few reads.
+void write_alignments(std::mt19937& rng, int n_refs, const std::string& fname)
+{
+    std::ofstream fout(fname.c_str());
+    std::vector<int> n_sites;
+    fout << n_refs << '\n';
+    for(int i = 0; i < n_refs; ++i)
+    {
+        n_sites.push_back(i == 1 ? 0 : 5 + rng() % 40);    // a reference without reads
+        fout << (n_sites.back() + 1) * 3000 << " chr" << i << '\n';
+    }
+    size_t q = 0;
+    for(int i = 0; i < n_refs; ++i)
+    {
+        std::vector<bool> flipped(n_sites[i]);
+        for(int s = 0; s < n_sites[i]; ++s)
+            flipped[s] = (rng() % 3 == 0);
+        for(int n = 0; n_sites[i] > 1 && n < 150 * n_sites[i]; ++n, ++q)
+        {
+            int s = rng() % n_sites[i];
+            int t = std::min(n_sites[i] - 1, s + 1 + int(rng() % 3));
+            if(t == s)  s = t - 1;
+            bool noise = (rng() % 20 == 0);
+            for(int end = 0; end < 2; ++end)
+            {
+                int site = (end == 0 ? s : t);
+                bool forward = (end == 0) != flipped[site];
+                if(noise && end == 1)
+                    forward = ! forward;
+                long long q_length = 300 + rng() % 700;
+                long long r_start = site * 3000 + rng() % 1500;
+                fout << i << " afun" << q << '_' << (end == 0 ? '5' : '3') << '_' << 3 * q_length << '/' << q << "/0_" << q_length
+                        << ' ' << q_length << ' ' << r_start << ' ' << r_start + q_length << ' '
+                        << 0 << ' ' << q_length << ' ' << 60 << ' ' << (forward ? 'F' : 'R') << '\n';
+            }
+        }
+    }
+    CHECK(fout.good());
+}
+
+}// anonymous namespace
+
+int main()
+{
+    std::mt19937 rng(4);
+    write_alignments(rng, 8, "alns.txt");
+    {
+        InvDector d;
+        d.read("alns.txt");
+        d.write_binary("alns.bin");
+    }
+    const int min_cvg = 0, min_overlap = 80, small_threshold = 15;
+    const double min_cvg_percent = 0.2;
+    const char* files[] = {".graph", ".cut", ".inv"};
+    for(int n_threads = 1; n_threads <= 4; n_threads += 3)
+    {
+        InvDector d;
+        d.read("alns.bin");
+        d.gen_graphs("passes.graph", min_cvg, min_cvg_percent, min_overlap, "", n_threads);
+        {
+            MaxCutBatch batch(small_threshold);
+            batch.read("passes.graph");
+            batch.solve(n_threads);
+            batch.write("passes.cut");
+        }
+        d.report_inversions("passes.graph", "passes.cut", "passes.inv", n_threads);
+
+        d.report("report.graph", "report.cut", "report.inv",
+                min_cvg, min_cvg_percent, min_overlap, "", small_threshold, n_threads);
+
+        InvDector s;
+        s.stream_report("alns.bin", "stream.graph", "stream.cut", "stream.inv",
+                min_cvg, min_cvg_percent, min_overlap, "", small_threshold, n_threads);
+
+        for(int f = 0; f < 3; ++f)
+        {
+            std::string passes = read_file(std::string("passes") + files[f]);
+            CHECK(! passes.empty());
+            CHECK(read_file(std::string("report") + files[f]) == passes);
+            CHECK(read_file(std::string("stream") + files[f]) == passes);
+            // and the same with any number of threads
+            if(n_threads == 1)
+                std::ofstream(std::string("one_thread") + files[f]) << passes;
+            else
+                CHECK(read_file(std::string("one_thread") + files[f]) == passes);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,93 @@
+// MaxCut::low_rank_sdp() must give the same cut with 1 and 4 threads, and
+// replace the current cut only by a better one.
+#include <random>
+#include <vector>
+#include <stdint.h>
+#include "maxcut.h"
+#include "check.h"
+
+using namespace loon;
+
+namespace
+{
+
+// the weight of the edges of `graph` across its solution
+int64_t cut_value(const MaxCut& graph)
+{
+    const std::vector<bool>& sides = graph.get_solution();
+    int64_t cut = 0;
+    for(size_t i = 0; i < graph.number_of_edges(); ++i)
+        if(sides[ graph.get_edge_u(i) ] != sides[ graph.get_edge_v(i) ])
+            cut += graph.get_edge_w(i);
+    return cut;
+}
+
+// a path through the nodes, then 3 more edges per node, a quarter of them negative
+void random_graph(std::mt19937& rng, int n_nodes, std::vector<int>& edges)
+{
+    edges.clear();
+    for(int i = 0; i + 1 < n_nodes; ++i)
+    {
+        edges.push_back(i);
+        edges.push_back(i + 1);
+        edges.push_back(1 + rng() % 5);
+    }
+    for(int j = 0; j < 3 * n_nodes; ++j)
+    {
+        int w = 1 + rng() % 20;
+        edges.push_back(rng() % n_nodes);
+        edges.push_back(rng() % n_nodes);
+        edges.push_back(rng() % 4 == 0 ? -w : w);
+    }
+}
+
+void load(const std::vector<int>& edges, MaxCut& graph)
+{
+    graph.clear();
+    for(size_t j = 0; j < edges.size(); j += 3)
+        graph.add_edge( edges[j], edges[j + 1], edges[j + 2] );
+}
+
+}// anonymous namespace
+
+int main()
+{
+    std::mt19937 rng(18);
+    std::vector<int> edges;
+    MaxCut one, several;
+    several.set_n_threads(4);
+    int n_improved = 0;
+    for(int round = 0; round < 20; ++round)
+    {
+        random_graph( rng, 30 + 20 * round, edges );
+        load( edges, one );
+        load( edges, several );
+
+        // from the spanning-tree cut, which the SDP may only improve
+        one.max_spanning_tree();
+        std::vector<bool> tree_solution = one.get_solution();
+        double tree_value = one.get_value();
+        one.low_rank_sdp();
+        CHECK(cut_value(one) == one.get_value());
+        CHECK(one.get_value() >= tree_value);
+        if(one.get_value() > tree_value)
+            ++n_improved;
+        else
+            CHECK(one.get_solution() == tree_solution);
+
+        several.max_spanning_tree();
+        several.low_rank_sdp();
+        CHECK(several.get_sdp_value() == one.get_sdp_value());
+        CHECK(several.get_value() == one.get_value());
+        CHECK(several.get_solution() == one.get_solution());
+
+        // the same rounding again finds no better cut, so it keeps the current one
+        std::vector<bool> sdp_solution = one.get_solution();
+        double sdp_value = one.get_value();
+        one.low_rank_sdp();
+        CHECK(one.get_value() == sdp_value);
+        CHECK(one.get_solution() == sdp_solution);
+    }
+    CHECK(n_improved > 0);
+    return 0;
+}
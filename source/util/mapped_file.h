@@ -0,0 +1,79 @@
+#ifndef __UTIL_MAPPED_FILE_H
+#define __UTIL_MAPPED_FILE_H
+
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace loon
+{
+/*! \ingroup Class_util
+ * @{
+ */
+
+/*!\brief A file mapped read-only into memory
+ *
+ * An empty file is opened successfully with `data() == NULL` and
+ * `size() == 0`. The mapping is released by close() or by the destructor.
+ */
+class MappedFile
+{
+private:
+    const char* ptr;
+    size_t length;
+
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+public:
+    MappedFile(): ptr(NULL), length(0) {}
+    ~MappedFile() { close(); }
+
+    /*!\brief Map the file `fname`
+     *
+     * `advice` is passed to `madvise()`, e.g. `MADV_SEQUENTIAL`.
+     * \return false if the file cannot be opened or mapped
+     */
+    bool open(const std::string& fname, int advice = MADV_NORMAL)
+    {
+        close();
+        int fd = ::open(fname.c_str(), O_RDONLY);
+        if(fd < 0)  return false;
+        struct stat st;
+        if(fstat(fd, &st) != 0)
+        {
+            ::close(fd);
+            return false;
+        }
+        if(st.st_size > 0)
+        {
+            void* addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(addr == MAP_FAILED)
+            {
+                ::close(fd);
+                return false;
+            }
+            madvise(addr, st.st_size, advice);
+            ptr = static_cast<const char*>(addr);
+            length = st.st_size;
+        }
+        ::close(fd);
+        return true;
+    }
+
+    void close()
+    {
+        if(ptr) munmap(const_cast<char*>(ptr), length);
+        ptr = NULL;
+        length = 0;
+    }
+
+    const char* data() const    { return ptr; }
+    size_t size() const         { return length; }
+};
+/*! @} */
+
+}// namespace loon
+
+#endif
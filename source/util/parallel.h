@@ -0,0 +1,71 @@
+#ifndef __UTIL_PARALLEL_H
+#define __UTIL_PARALLEL_H
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <exception>
+
+namespace loon
+{
+/*! \ingroup Class_util
+ * @{
+ */
+
+/*!\brief Run `func(i)` for every `i` in `[0, n)` on `n_threads` threads
+ *
+ * The indices are handed out one by one in increasing order to whichever
+ * thread is free, so putting the expensive tasks first gives a good balance.
+ * The calling thread is one of the workers. If `n_threads <= 1`, the loop
+ * simply runs in the calling thread.
+ *
+ * If `func` throws, the remaining indices are skipped and the first exception
+ * is rethrown in the calling thread after all the workers have finished.
+ */
+template<class Func>
+void parallel_for(size_t n, int n_threads, Func func)
+{
+    if(n_threads <= 1 || n <= 1)
+    {
+        for(size_t i = 0; i < n; ++i)
+            func(i);
+        return;
+    }
+    if(size_t(n_threads) > n)   n_threads = n;
+
+    std::atomic<size_t> next(0);
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    auto worker = [&]()
+    {
+        size_t i;
+        while((i = next++) < n)
+        {
+            try
+            {
+                func(i);
+            }
+            catch(...)
+            {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if(! error) error = std::current_exception();
+                next = n;
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(n_threads - 1);
+    for(int t = 1; t < n_threads; ++t)
+        threads.push_back( std::thread(worker) );
+    worker();
+    for(size_t t = 0; t < threads.size(); ++t)
+        threads[t].join();
+    if(error)   std::rethrow_exception(error);
+}
+/*! @} */
+
+}// namespace loon
+
+#endif